@@ -1,8 +1,47 @@
 #pragma once
 
+#include <cstdint>
 #include "MessageQueue.hpp"
 
+class MetricsWriter;
+
+enum class JpegEncoder : uint8_t {
+    TurboJpeg, // libjpeg-turbo fed the camera's YUV planes (needs HAVE_TURBOJPEG)
+    OpenCv     // YUYV -> BGR, then cv::imencode
+};
+
+struct CompressionConfig {
+    JpegEncoder encoder = JpegEncoder::TurboJpeg; // Falls back to OpenCv when unavailable
+    bool chroma420 = false;                       // Turbo only: 4:2:0 instead of the camera's 4:2:2
+
+    // Motion gate: encode a frame only if its luma, scaled down 4x, differs
+    // from the last encoded frame in at least motionMinBlocks 8x8 blocks
+    // (32x32 in the frame) by a mean of more than motionThreshold levels
+    bool motionGate = false;
+    int motionThreshold = 6;
+    int motionMinBlocks = 2;
+    unsigned keyframeInterval = 150; // Encode at least every n-th frame anyway, 0 = never forced
+
+    // Adaptive quality: lower JPEG quality, then resolution (half, quarter),
+    // while encoding takes longer than encodeBudgetUs per frame or the output
+    // exceeds bitrateKbps (0 = no limit); every frame's settings are logged
+    bool adaptiveQuality = false;
+    uint32_t encodeBudgetUs = 20000;
+    uint32_t bitrateKbps = 0;
+};
+
 // Image compression service function
 void imageCompressionService();
 
-void initCompressionService();
\ No newline at end of file
+void initCompressionService(const CompressionConfig& config = {});
+
+// Write out the images still queued, stop the writer thread and print encode
+// times and motion gate counts
+void deinitCompressionService();
+
+// Encoder in use after initCompressionService, for the startup log
+const char* compressionEncoderName();
+
+// Encode times, gate counts and current settings, plus the image writer's
+// counters, for the metrics socket
+void collectCompressionMetrics(MetricsWriter& out);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <sched.h>
+
+// A set of CPUs, e.g. the ones a service may run on. Parsed from and printed
+// as kernel CPU lists ("0-3,6").
+class CpuSet
+{
+public:
+    CpuSet() { CPU_ZERO(&_set); }
+
+    static CpuSet single(unsigned cpu)
+    {
+        CpuSet set;
+        set.add(cpu);
+        return set;
+    }
+
+    // Kernel list format; returns false (and leaves set untouched) on a syntax error
+    static bool parse(const std::string& list, CpuSet& set);
+
+    void add(unsigned cpu)
+    {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &_set);
+        }
+    }
+    void remove(unsigned cpu)
+    {
+        if (cpu < CPU_SETSIZE) {
+            CPU_CLR(cpu, &_set);
+        }
+    }
+    bool contains(unsigned cpu) const { return cpu < CPU_SETSIZE && CPU_ISSET(cpu, &_set); }
+    unsigned count() const { return static_cast<unsigned>(CPU_COUNT(&_set)); }
+    bool empty() const { return count() == 0; }
+
+    // Lowest CPU in the set, CPU_SETSIZE if empty
+    unsigned first() const;
+
+    CpuSet operator&(const CpuSet& other) const;
+    CpuSet operator|(const CpuSet& other) const;
+    CpuSet operator-(const CpuSet& other) const;
+    bool operator==(const CpuSet& other) const { return CPU_EQUAL(&_set, &other._set); }
+
+    std::string toString() const;
+    const cpu_set_t& native() const { return _set; }
+
+private:
+    cpu_set_t _set;
+};
+
+// What the kernel says about the CPUs we may use, from sysfs and our own
+// affinity mask
+struct CpuTopology {
+    CpuSet online;   // /sys/devices/system/cpu/online
+    CpuSet allowed;  // sched_getaffinity of the process, within online
+    CpuSet isolated; // isolcpus=, /sys/devices/system/cpu/isolated
+    CpuSet nohzFull; // nohz_full=, /sys/devices/system/cpu/nohz_full
+    CpuSet primary;  // One hardware thread per physical core (the lowest SMT sibling)
+};
+
+bool readCpuTopology(CpuTopology& topology);
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Smoothing applied to detected centers before they become cursor positions
+enum class CursorFilterType : uint8_t {
+    MovingAverage, // Mean of the last MOVING_AVERAGE_WINDOW samples
+    OneEuro,       // Adaptive low-pass: smooth when still, little lag when moving
+    Kalman         // Constant-velocity model, extrapolated to the current time
+};
+
+struct CursorFilterConfig {
+    CursorFilterType type = CursorFilterType::OneEuro;
+
+    // One-Euro: cutoff = minCutoffHz + beta * |speed in px/s|
+    double minCutoffHz = 1.0;
+    double beta = 0.01;
+    double derivativeCutoffHz = 1.0;
+
+    // Kalman: white-noise acceleration (px^2/s^3) and measurement noise (px^2)
+    double processNoise = 20000.0;
+    double measurementNoise = 25.0;
+    double maxPredictionMs = 100.0; // Never extrapolate further than this past the last sample
+};
+
+// Fixed-size filter state for a 2D position. Samples carry the capture time
+// of the frame they were detected in, so the filters see the real sample
+// spacing even when detection runs late or skips frames.
+class CursorFilter
+{
+public:
+    static constexpr size_t MOVING_AVERAGE_WINDOW = 5;
+
+    explicit CursorFilter(const CursorFilterConfig& config = {}) : _config(config) {}
+
+    void configure(const CursorFilterConfig& config);
+    void reset();
+    CursorFilterType type() const { return _config.type; }
+
+    // Feed a measured position taken at timestampNs (CLOCK_MONOTONIC)
+    void update(double x, double y, uint64_t timestampNs);
+
+    // Filtered position at nowNs. Only the Kalman filter extrapolates; the
+    // others return their estimate at the last sample. False before the first sample.
+    bool position(uint64_t nowNs, double& x, double& y) const;
+
+private:
+    // Gap after which the old state says nothing about the new sample (face lost)
+    static constexpr uint64_t RESET_GAP_NS = 1'000'000'000ULL;
+
+    struct OneEuroAxis {
+        double value;
+        double derivative;
+    };
+
+    struct KalmanAxis {
+        double position;
+        double velocity;
+        double p00, p01, p11; // Symmetric covariance
+    };
+
+    CursorFilterConfig _config;
+    bool _initialized = false;
+    uint64_t _lastNs = 0;
+
+    // Moving average: ring of the last samples with running sums
+    double _windowX[MOVING_AVERAGE_WINDOW] = {};
+    double _windowY[MOVING_AVERAGE_WINDOW] = {};
+    size_t _windowCount = 0;
+    size_t _windowNext = 0;
+    double _sumX = 0.0;
+    double _sumY = 0.0;
+
+    OneEuroAxis _euro[2] = {};
+    KalmanAxis _kalman[2] = {};
+
+    void _start(double x, double y);
+    void _updateOneEuro(OneEuroAxis& axis, double measured, double dt);
+    void _updateKalman(KalmanAxis& axis, double measured, double dt);
+};
@@ -1,7 +1,15 @@
 #pragma once
 #include <cstdint>
 #include <fcntl.h>
-uint8_t cursorInit(uint8_t detectiontype);
+#include "CursorFilter.hpp"
+class MetricsWriter;
+// With continuousOutput the cursor is moved by cursorOutputService, which must
+// then be scheduled; otherwise cursorTranslationService moves it per center
+uint8_t cursorInit(uint8_t detectiontype, const CursorFilterConfig& filter = {}, bool continuousOutput = false);
 void cursorDeinit();
 // Declaration of the producer service function
 void cursorTranslationService();
+// Moves the cursor along the latest filtered target at its own (high) rate
+void cursorOutputService();
+// uinput write counters for the metrics socket
+void collectCursorMetrics(MetricsWriter& out);
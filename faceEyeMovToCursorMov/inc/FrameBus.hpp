@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include "FramePool.hpp"
+#include "SpscRing.hpp"
+
+class MetricsWriter;
+
+// In-process fan-out of captured frames. Each subscriber gets its own SPSC
+// queue of frame handles; publishing only bumps the frame's reference count
+// once per subscriber. A subscriber whose queue is full misses that frame.
+class FrameBus
+{
+public:
+    static constexpr int MAX_SUBSCRIBERS = 4;
+    static constexpr size_t QUEUE_DEPTH = 2;
+
+    // Register a consumer; only valid before services are started.
+    // Returns the subscriber id, or -1 when all slots are taken.
+    int subscribe(const char* name);
+
+    // Have publish() call listener (on the publishing thread) after queueing
+    // a frame for the named subscriber, e.g. to release its service. Only
+    // valid before services are started. Returns false for an unknown name.
+    bool setListener(const char* name, std::function<void()> listener);
+
+    void publish(const FrameRef& frame);
+    bool poll(int subscriber, FrameRef& frame);
+
+    // Drop every queued frame. Only valid once publisher and subscribers have stopped.
+    void clear();
+
+    void logStatistics() const;
+    void collectMetrics(MetricsWriter& out) const;
+
+private:
+    struct Subscriber {
+        const char* name = nullptr;
+        SpscRing<FrameRef, QUEUE_DEPTH> queue;
+        std::function<void()> listener;
+        std::atomic<uint64_t> delivered{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    Subscriber _subscribers[MAX_SUBSCRIBERS];
+    int _subscriberCount = 0;
+    std::atomic<uint64_t> _published{0};
+};
+
+extern FrameBus frame_bus;
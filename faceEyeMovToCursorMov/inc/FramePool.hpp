@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "FrameSource.hpp"
+#include "MessageQueue.hpp"
+
+// A captured frame as seen by consumers. The pixels are not copied: data
+// points into the source's buffer for as long as a FrameRef to it exists.
+struct Frame {
+    FrameMetadata metadata;
+    const void* data;
+};
+
+class FramePool;
+
+// Intrusively refcounted handle to a pooled frame. Copying a FrameRef only
+// bumps an atomic count; when the last handle is dropped the buffer is
+// returned to its FrameSource (for V4L2, queued back to the driver).
+class FrameRef
+{
+public:
+    FrameRef() = default;
+    FrameRef(const FrameRef& other);
+    FrameRef(FrameRef&& other) noexcept : _slot(other._slot) { other._slot = nullptr; }
+    FrameRef& operator=(const FrameRef& other);
+    FrameRef& operator=(FrameRef&& other) noexcept;
+    ~FrameRef() { reset(); }
+
+    void reset();
+
+    const Frame* operator->() const;
+    const Frame& operator*() const { return *operator->(); }
+    explicit operator bool() const { return _slot != nullptr; }
+
+private:
+    friend class FramePool;
+    struct Slot;
+    explicit FrameRef(Slot* slot) : _slot(slot) {}
+
+    Slot* _slot = nullptr;
+};
+
+// One slot per source buffer, each with an atomic reference count. The pool
+// also keeps the counters that tell us whether the buffer count is adequate.
+class FramePool
+{
+public:
+    // Size the pool to the source's buffer count; call after source.open()
+    void init(FrameSource* source);
+
+    // Wrap a freshly acquired buffer; the returned reference is the first one
+    FrameRef wrap(const CapturedFrame& captured, const FrameMetadata& metadata);
+
+    // Called when the source had no frame for us: counts an exhaustion when
+    // every buffer is held by consumers, i.e. the driver has none to fill
+    void noteNoFrame();
+
+    unsigned int size() const { return _size; }
+    unsigned int outstanding() const { return _outstanding.load(std::memory_order_relaxed); }
+
+    void logStatistics() const;
+
+private:
+    friend class FrameRef;
+
+    std::unique_ptr<FrameRef::Slot[]> _slots;
+    unsigned int _size = 0;
+    FrameSource* _source = nullptr;
+
+    std::atomic<unsigned int> _outstanding{0};
+    unsigned int _maxOutstanding = 0;
+    uint64_t _captured = 0;
+    uint64_t _exhausted = 0;
+    uint64_t _sourceDropped = 0; // Gaps in the source sequence numbers
+    uint32_t _lastSequence = 0;
+
+    void _recycle(FrameRef::Slot* slot);
+};
+
+struct FrameRef::Slot {
+    Frame frame;
+    std::atomic<uint32_t> refs{0};
+    unsigned int index = 0;
+    FramePool* pool = nullptr;
+};
+
+inline const Frame* FrameRef::operator->() const
+{
+    return &_slot->frame;
+}
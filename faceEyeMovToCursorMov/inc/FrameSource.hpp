@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <linux/videodev2.h>
+
+// A frame handed out by a FrameSource. The data pointer stays valid until the
+// frame's buffer index is given back to the source with release().
+struct CapturedFrame {
+    unsigned int index;
+    void* data;
+    size_t size;
+    int width;
+    int height;
+    uint32_t format;
+    uint32_t sequence;         // Source frame counter, gaps mean frames were lost
+    struct timespec timestamp; // Capture time on CLOCK_MONOTONIC
+};
+
+// Abstract producer of raw frames for imageCaptureService. acquire() never
+// blocks: it returns false when no frame is ready at the time of the call.
+// Buffers are indexed 0..bufferCount()-1; release() may be called from any
+// thread, once per acquired frame.
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual bool acquire(CapturedFrame& frame) = 0;
+    virtual void release(unsigned int index) = 0;
+    virtual unsigned int bufferCount() const = 0;
+};
+
+// Live camera backend: mmap'd V4L2 streaming I/O on a YUYV device.
+class V4L2FrameSource : public FrameSource {
+public:
+    V4L2FrameSource(std::string device, unsigned int bufferCount) :
+        _device(std::move(device)), _requestedBuffers(bufferCount) {}
+    ~V4L2FrameSource() override { close(); }
+
+    bool open() override;
+    void close() override;
+    bool acquire(CapturedFrame& frame) override;
+    void release(unsigned int index) override;
+    unsigned int bufferCount() const override { return _numBuffers; }
+
+private:
+    std::string _device;
+    unsigned int _requestedBuffers;
+    unsigned int _numBuffers = 0; // What the driver actually granted
+    int _fd = -1;
+    int _width = 0;
+    int _height = 0;
+
+    // Buffer array preserving the original configurations
+    std::vector<struct v4l2_buffer> _buffers;
+    // Track buffer state (true = queued to the driver). Flipped by the capture
+    // thread on dequeue and by whichever consumer drops the last reference.
+    std::unique_ptr<std::atomic<bool>[]> _bufferQueued;
+    std::vector<void*> _bufferStarts;
+    std::vector<unsigned int> _bufferLengths;
+
+    bool _queueBuffer(unsigned int index);
+    void _unmapBuffers(unsigned int count);
+};
+
+// Layout of a recording made by FrameRecorder: a RecordingFileHeader followed
+// by one RecordedFrameHeader + raw payload per frame.
+struct RecordingFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct RecordedFrameHeader {
+    uint64_t timestamp_ns; // Original capture time on CLOCK_MONOTONIC
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t data_size;
+};
+
+static constexpr char RECORDING_MAGIC[8] = {'Y', 'U', 'Y', 'V', 'R', 'E', 'C', '1'};
+static constexpr uint32_t RECORDING_VERSION = 1;
+
+// Offline backend: replays a recording made by FrameRecorder. Frames are
+// presented at their original spacing divided by speed; a speed of 0 hands
+// out one frame per acquire() call as fast as the capture service runs.
+class FileFrameSource : public FrameSource {
+public:
+    FileFrameSource(std::string path, double speed, bool loop, unsigned int bufferCount) :
+        _path(std::move(path)), _speed(speed), _loop(loop), _numBuffers(bufferCount),
+        _buffers(bufferCount), _bufferInUse(new std::atomic<bool>[bufferCount]()) {}
+    ~FileFrameSource() override { close(); }
+
+    bool open() override;
+    void close() override;
+    bool acquire(CapturedFrame& frame) override;
+    void release(unsigned int index) override;
+    unsigned int bufferCount() const override { return _numBuffers; }
+
+private:
+    std::string _path;
+    double _speed;
+    bool _loop;
+    unsigned int _numBuffers;
+    std::ifstream _file;
+    std::streampos _firstFrameOffset;
+    uint32_t _sequence = 0;
+
+    std::vector<std::vector<unsigned char>> _buffers;
+    std::unique_ptr<std::atomic<bool>[]> _bufferInUse;
+
+    // Header of the next frame to present, read ahead so we know when it is due
+    RecordedFrameHeader _pending = {};
+    bool _havePending = false;
+    bool _finished = false;
+
+    // Maps recording time to CLOCK_MONOTONIC: base times of the current pass
+    uint64_t _recordingBaseNs = 0;
+    uint64_t _clockBaseNs = 0;
+    bool _baseSet = false;
+    uint64_t _lastTimestampNs = 0; // Recording time of the last frame presented
+    uint64_t _lastDueNs = 0;       // and when it was presented
+
+    // Reads the next frame header; a header that fails _pendingIsValid()
+    // ends the recording there
+    bool _readPendingHeader();
+    bool _pendingIsValid() const;
+};
+
+// Dumps frames with their capture timestamps in the format FileFrameSource reads.
+class FrameRecorder {
+public:
+    bool open(const std::string& path);
+    void write(const CapturedFrame& frame);
+    void close();
+    bool isOpen() const { return _file.is_open(); }
+
+private:
+    std::ofstream _file;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+// The percentiles reported for a latency distribution
+struct HistogramSummary {
+    uint64_t count = 0;
+    double mean = 0.0;
+    uint64_t p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0;
+};
+
+// Fixed-memory log-linear histogram (HDR style). Values below 2*SUB_BUCKETS
+// are counted exactly; above that every power of two is split into
+// SUB_BUCKETS linear buckets, so the relative error stays below 1/SUB_BUCKETS.
+// Recording is wait-free and may run concurrently with readers on other threads.
+class Histogram
+{
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+    static constexpr unsigned MAX_VALUE_BITS = 32; // Values are clamped to 2^32 - 1
+    static constexpr unsigned NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void record(uint64_t value)
+    {
+        value = std::min<uint64_t>(value, (1ULL << MAX_VALUE_BITS) - 1);
+        _buckets[_bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t max = _max.load(std::memory_order_relaxed);
+        while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+        uint64_t min = _min.load(std::memory_order_relaxed);
+        while (value < min && !_min.compare_exchange_weak(min, value, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+    uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+    uint64_t min() const { return count() ? _min.load(std::memory_order_relaxed) : 0; }
+    double mean() const { return count() ? static_cast<double>(_sum.load(std::memory_order_relaxed)) / count() : 0.0; }
+
+    // Value at the given percentile (0-100), reported as the upper edge of
+    // the bucket it falls in and never above the recorded maximum
+    uint64_t percentile(double p) const
+    {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t target = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+        target = std::clamp<uint64_t>(target, 1, total);
+
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
+            seen += _buckets[i].load(std::memory_order_relaxed);
+            if (seen >= target) {
+                return std::min(_bucketUpperEdge(i), max());
+            }
+        }
+        return max();
+    }
+
+    HistogramSummary summary() const
+    {
+        return {count(), mean(), percentile(50), percentile(90), percentile(99), percentile(99.9), max()};
+    }
+
+    void reset()
+    {
+        for (auto& bucket : _buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        _count.store(0, std::memory_order_relaxed);
+        _sum.store(0, std::memory_order_relaxed);
+        _max.store(0, std::memory_order_relaxed);
+        _min.store(UINT64_MAX, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> _buckets[NUM_BUCKETS] = {};
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _sum{0};
+    std::atomic<uint64_t> _max{0};
+    std::atomic<uint64_t> _min{UINT64_MAX};
+
+    static unsigned _bucketIndex(uint64_t value)
+    {
+        if (value < 2 * SUB_BUCKETS) {
+            return static_cast<unsigned>(value);
+        }
+        unsigned msb = 63 - __builtin_clzll(value);
+        unsigned shift = msb - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<unsigned>((value >> shift) - SUB_BUCKETS);
+    }
+
+    static uint64_t _bucketUpperEdge(unsigned index)
+    {
+        if (index < 2 * SUB_BUCKETS) {
+            return index;
+        }
+        unsigned shift = index / SUB_BUCKETS - 1;
+        uint64_t sub = index % SUB_BUCKETS + SUB_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+};
@@ -1,7 +1,19 @@
 #pragma once
 
+#include <string>
 #include "MessageQueue.hpp"
 
+// Selects and configures the frame source behind imageCaptureService
+struct CaptureConfig {
+    std::string device = "/dev/video0"; // V4L2 device for live capture
+    std::string replayFile;             // Non-empty selects the file backend
+    double replaySpeed = 1.0;           // Replay rate multiplier, 0 = as fast as released
+    bool replayLoop = false;            // Restart the recording when it ends
+    std::string recordFile;             // Non-empty dumps every captured frame here
+    unsigned int bufferCount = 8;       // Frame buffers shared by capture and all consumers
+};
+
 // Declaration of the image capture service function
 void imageCaptureService();
-void imageCaptureInit();
+bool imageCaptureInit(const CaptureConfig& config);
+void imageCaptureDeinit();
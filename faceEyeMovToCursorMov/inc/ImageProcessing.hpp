@@ -6,17 +6,41 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/objdetect/objdetect.hpp>
 #include "MessageQueue.hpp"
+#include <functional>
 #include <vector>
 #include <string>
-#include <zmq.hpp>
 
 #define NSEC_PER_SEC (1000000000)
 #define NSEC_PER_MSEC (1000000)
 #define NSEC_PER_MICROSEC (1000)
 
-void faceCenterDetectionService();
 void initFaceCenterService();
-void initImageProcessingService(int type);
+// Tunables for DetectionService
+struct DetectionConfig {
+    bool faceTracking = true; // Search around the previous face instead of scanning every frame
+    int lumaDecimation = 1;   // 1 = full resolution, 2 or 4 = detect on box-filtered luma
+    bool overlay = false;     // Convert to BGR and show detections in a debug window
+    int workers = 0;          // Detection threads fed by DetectionService, 0 = detect inline
+};
+
+static constexpr int MAX_DETECTION_WORKERS = 4;
+
+void initImageProcessingService(int type, const DetectionConfig& config = {});
+// Drops every frame the detection stage still holds; call after the services stopped
+void deinitImageProcessingService();
+void logDetectionStatistics();
+
+// Show the newest --overlay frame, if a new one arrived, and run the HighGUI
+// event loop. Only from a non-real-time thread: it may block on X11.
+void showDetectionOverlay();
+
+// Worker pool: each worker runs detectionWorkerService(index) on its own
+// service thread. DetectionService calls the worker listener after queueing
+// a frame for it, and workers call the result listener after finishing one,
+// e.g. to release the respective services. Set before services are started.
+void detectionWorkerService(int index);
+void setDetectionWorkerListener(int index, std::function<void()> listener);
+void setDetectionResultListener(std::function<void()> listener);
 void DetectionService(void);
 
 #endif // EYE_DETECTION_HPP
\ No newline at end of file
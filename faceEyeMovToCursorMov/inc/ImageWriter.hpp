@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class MetricsWriter;
+
+// Persists encoded images off the real-time path. The compression service
+// hands each JPEG to a bounded queue and a low-priority thread appends the
+// queued images in batches to segment files (see SegmentFormat.hpp), using
+// io_uring when built with HAVE_LIBURING and pwritev otherwise. When storage
+// falls behind, the oldest queued image is dropped: the producer never waits
+// on the filesystem.
+struct ImageWriterConfig {
+    std::string directory = "recording";
+    uint64_t segmentBytes = 256ULL << 20; // Preallocated per segment, rotated when full
+    uint32_t segmentSeconds = 600;        // Also rotated after this long, 0 = by size only
+    size_t queueDepth = 16;               // Images held while storage is slow
+    size_t batchSize = 8;                 // Images written per submission
+};
+
+bool imageWriterInit(const ImageWriterConfig& config = {});
+
+// Stop accepting images, write out what is still queued and join the thread
+void imageWriterDeinit();
+
+// Queue the first size bytes of data to be recorded with its frame id and
+// capture time. The buffer is swapped into the queue and data gets back a
+// recycled one (contents stale, size and capacity kept), so steady-state
+// submission neither allocates nor clears. Never blocks; returns false if an
+// older image had to be dropped to make room.
+bool imageWriterSubmit(std::vector<unsigned char>& data, size_t size, uint64_t frameId, uint64_t timestampNs);
+
+// "io_uring" or "pwritev", whichever is in use
+const char* imageWriterBackend();
+
+void logImageWriterStatistics();
+
+// Queue and storage counters for the metrics socket; reads no locked state
+void collectImageWriterMetrics(MetricsWriter& out);
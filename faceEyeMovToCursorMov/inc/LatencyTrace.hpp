@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include "Histogram.hpp"
+
+class MetricsWriter;
+
+// Pipeline stages a frame passes through on its way from the camera to the cursor
+enum class Stage : uint8_t {
+    Capture,
+    Detection,
+    CursorTranslation,
+    CursorOutput, // From the cursor target being ready to the cursor first moving towards it
+    Compression,
+    Count
+};
+
+// Start tracing a frame; capture_ns is the V4L2 buffer timestamp
+void latencyTraceBegin(uint64_t frame_id, uint64_t capture_ns);
+
+// Stamp a stage's enter/exit times for a frame. Exiting records how long the
+// stage took and how old the frame was when it left the stage; exiting
+// CursorOutput completes the capture-to-cursor measurement.
+void latencyTraceEnter(uint64_t frame_id, Stage stage);
+void latencyTraceExit(uint64_t frame_id, uint64_t capture_ns, Stage stage);
+
+// Capture-to-cursor latency histogram in microseconds
+const Histogram& latencyTraceEndToEnd();
+
+// Print p50/p99/max end-to-end and per stage
+void latencyTraceReport();
+
+// End-to-end and per-stage histograms for the metrics socket
+void collectLatencyTraceMetrics(MetricsWriter& out);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary event log, shared with the logDecoder tool. The file is a
+// LogFileHeader followed by LogRecords in the order they were drained
+// (sorted by time within each drain). Host (little-endian) byte order.
+
+static constexpr char LOG_FILE_MAGIC[8] = {'F', 'E', 'M', 'L', 'O', 'G', '0', '1'};
+static constexpr uint32_t LOG_FILE_VERSION = 1;
+static constexpr size_t LOG_VALUES = 6;
+
+enum class LogEvent : uint16_t {
+    CursorMove = 1,   // Detected center turned into a cursor position
+    FrameEncoded = 2, // Compression settings and cost of one frame
+};
+
+struct LogFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t monotonicStartNs; // CLOCK_MONOTONIC and CLOCK_REALTIME read together
+    uint64_t realtimeStartNs;  // at startup, to put wall-clock times on records
+};
+
+struct LogRecord {
+    uint64_t timestampNs; // CLOCK_MONOTONIC
+    uint16_t event;       // LogEvent
+    uint16_t source;      // Ring the record came from, one per logging thread
+    uint32_t sequence;    // Per-source counter; a gap means records were dropped
+    int64_t values[LOG_VALUES];
+};
+
+static_assert(sizeof(LogFileHeader) == 32, "log header layout changed");
+static_assert(sizeof(LogRecord) == 64, "log record layout changed");
+
+// Names used by the decoder for events and their values
+struct LogEventInfo {
+    LogEvent event;
+    const char* name;
+    const char* fields[LOG_VALUES];
+};
+
+inline constexpr LogEventInfo LOG_EVENTS[] = {
+    {LogEvent::CursorMove, "cursor", {"frame", "center_x", "center_y", "cursor_x", "cursor_y", "latency_us"}},
+    {LogEvent::FrameEncoded, "encode", {"frame", "quality", "downscale", "encode_us", "bytes", "bitrate_kbps"}},
+};
@@ -1,17 +1,24 @@
 #pragma once
 
-#include <zmq.hpp>
+#include <cstdint>
 #include <string>
-#include "MessageQueue.hpp"
+#include "LogFormat.hpp"
 
-// Declaration of the message queue service function
-void messageQueueToCsvService();
+// Event logging for the real-time threads. Each thread appends fixed-size
+// records to its own lock-free ring; a low-priority writer thread drains all
+// rings in bulk into a binary file (see LogFormat.hpp), which logDecoder
+// turns into CSV. logEvent never blocks, allocates or enters the kernel
+// beyond reading the clock; if a ring is full the record is counted as
+// dropped.
 
-//Logging servic initialization
-void initLoggingService();
+// path empty: data_<local date and time>.bin in the working directory
+bool initLoggingService(const std::string& path = "");
 
-// Function to get the CSV filename
-std::string getCsvFileName();
+// Drain what is left, close the file and print the record counts
+void deinitLoggingService();
 
-// Function to flush the CSV file
-void flushCsvFile();
\ No newline at end of file
+void logEvent(LogEvent event, int64_t v0 = 0, int64_t v1 = 0, int64_t v2 = 0,
+              int64_t v3 = 0, int64_t v4 = 0, int64_t v5 = 0);
+
+// File the log is written to
+std::string getLogFileName();
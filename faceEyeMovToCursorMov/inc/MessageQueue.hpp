@@ -1,18 +1,51 @@
 #pragma once
 
 #include <zmq.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "SpscRing.hpp"
+
+// Header sent ahead of every raw frame
+struct FrameMetadata {
+    int width;
+    int height;
+    uint32_t format;
+    size_t data_size;
+    uint64_t frame_id;   // Sequence number assigned by imageCaptureService
+    uint64_t capture_ns; // V4L2 buffer timestamp (CLOCK_MONOTONIC)
+};
+
+// True if the payload is large enough for a packed YUYV frame of the stated
+// size, i.e. consumers may read width * height * 2 bytes from it
+inline bool frameHoldsYuyv(const FrameMetadata& metadata)
+{
+    return metadata.width > 0 && metadata.height > 0
+           && metadata.data_size >= static_cast<size_t>(metadata.width) * metadata.height * 2;
+}
+
+// Face/eye center sent from DetectionService to cursorTranslationService,
+// carrying the provenance of the frame it was detected in
+struct CenterMessage {
+    uint64_t frame_id;
+    uint64_t capture_ns;
+    int x;
+    int y;
+};
 
 extern zmq::context_t zmq_context;
 
-// Sockets for image data
-extern zmq::socket_t zmq_push_socket;  // Used by imageCaptureService to send images
-extern zmq::socket_t zmq_pull_socket;  // Used by imageCompressionService to receive images
+// Optional external transport for raw frames (metadata + frame multi-part)
+extern zmq::socket_t zmq_pub_socket;
+extern bool zmq_frame_export_enabled;
 
-// Sockets for control messages
-extern zmq::socket_t zmq_push_control_socket;  // Used for sending timestamp to LoggingService
-extern zmq::socket_t zmq_pull_control_socket;  // Used by Logging to receive the messages sent to this service
+// Face centers from DetectionService to cursorTranslationService
+extern SpscRing<CenterMessage, 16> face_center_queue;
+// Called by DetectionService after each push, e.g. to release the cursor
+// service on data. Set before services are started; may stay empty.
+extern std::function<void()> face_center_listener;
 
-extern zmq::socket_t zmq_push_face_socket;
-extern zmq::socket_t zmq_pull_face_socket;
-void initialize_zmq();
-void cleanup_zmq();
\ No newline at end of file
+// frame_export_endpoint: ZMQ endpoint to publish raw frames on, empty to disable
+void initialize_zmq(const std::string& frame_export_endpoint);
+void cleanup_zmq();
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "Histogram.hpp"
+
+// Live metrics in the Prometheus text format, served on a Unix domain socket
+// by a low-priority thread. Nothing is pushed from the real-time threads:
+// modules register collectors that, on each scrape, read the counters,
+// gauges and histograms they already keep with relaxed atomic loads. A
+// scrape therefore never takes a lock a service could be waiting on.
+//
+//   curl --unix-socket /tmp/faceEyeMov.metrics http://localhost/metrics
+//   socat - UNIX-CONNECT:/tmp/faceEyeMov.metrics
+//
+// Either works: an HTTP request gets an HTTP response, anything else the bare text.
+
+// Renders one scrape. Samples of a metric must be written back to back
+// (HELP/TYPE are emitted once, for the first). labels is the inside of the
+// braces, e.g. "service=\"imageCaptureService\"", or nullptr for none.
+class MetricsWriter
+{
+public:
+    explicit MetricsWriter(std::string& out) : _out(out) {}
+
+    void counter(const char* name, const char* help, double value, const char* labels = nullptr);
+    void gauge(const char* name, const char* help, double value, const char* labels = nullptr);
+
+    // Summary with p50/p90/p99/p99.9, _sum and _count; recorded values are
+    // multiplied by scale (e.g. 1e-6 for microseconds to seconds)
+    void summary(const char* name, const char* help, const Histogram& histogram, double scale,
+                 const char* labels = nullptr);
+
+private:
+    void _header(const char* name, const char* help, const char* type);
+    void _sample(const char* name, const char* suffix, const char* labels, const char* extraLabel, double value);
+
+    std::string& _out;
+    std::string _lastName;
+};
+
+using MetricsCollector = std::function<void(MetricsWriter&)>;
+
+// Add a collector; only valid before metricsInit
+void metricsRegister(MetricsCollector collector);
+
+// Start serving on path (replacing a stale socket file)
+bool metricsInit(const std::string& path);
+
+// Stop the server thread and remove the socket file
+void metricsDeinit();
+
+// One scrape into out, as served on the socket
+void metricsRender(std::string& out);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <pthread.h>
+
+// pthread mutex with priority inheritance: a low-priority holder is boosted
+// while a real-time thread waits on it, bounding the inversion. Satisfies
+// Lockable, so it works with std::lock_guard and std::unique_lock.
+class PiMutex
+{
+public:
+    PiMutex()
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+        pthread_mutex_init(&_mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+    ~PiMutex() { pthread_mutex_destroy(&_mutex); }
+
+    PiMutex(const PiMutex&) = delete;
+    PiMutex& operator=(const PiMutex&) = delete;
+
+    void lock() { pthread_mutex_lock(&_mutex); }
+    void unlock() { pthread_mutex_unlock(&_mutex); }
+    bool try_lock() { return pthread_mutex_trylock(&_mutex) == 0; }
+
+private:
+    pthread_mutex_t _mutex;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Pixel-format kernels on packed YUYV (Y0 U Y1 V per pixel pair). Widths are
+// in pixels and must be even, strides are in bytes. The fastest implementation
+// the CPU supports (AVX2, SSE2/SSSE3, NEON or scalar) is picked on first use;
+// setting PIXEL_KERNELS to another supported one (e.g. scalar) in the
+// environment forces that one. NEON is only built with `make NEON=1`. Every
+// implementation produces bit-identical output, which `make test` checks
+// against the scalar one.
+
+// Luma only: dst is width x height
+void yuyvToY(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, int width, int height);
+
+// Luma with a 2x2 (factor 2) or 4x4 (factor 4) box filter: dst is
+// width/factor x height/factor, partial blocks at the edges are dropped
+void yuyvToYDecimated(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride,
+                      int width, int height, int factor);
+
+// Planar I420: y is width x height, u and v are width/2 x height/2 with
+// chroma averaged over each pair of rows. Planes are tightly packed and
+// height must be even.
+void yuyvToI420(const uint8_t* src, size_t srcStride, uint8_t* y, uint8_t* u, uint8_t* v,
+                int width, int height);
+
+// Planar I420 scaled down by factor (2 or 4): y is width/factor x
+// height/factor, filtered as by yuyvToYDecimated, and u and v are half that
+// in each direction. width/factor and height/factor must be even.
+void yuyvToI420Decimated(const uint8_t* src, size_t srcStride, uint8_t* y, uint8_t* u, uint8_t* v,
+                         int width, int height, int factor);
+
+// Planar I422: y is width x height, u and v are width/2 x height. Planes
+// are tightly packed.
+void yuyvToI422(const uint8_t* src, size_t srcStride, uint8_t* y, uint8_t* u, uint8_t* v,
+                int width, int height);
+
+// Packed BGR24 using BT.601 limited range coefficients (as COLOR_YUV2BGR_YUYV)
+void yuyvToBgr(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, int width, int height);
+
+// Sum of absolute differences of two 8-bit images over each 8x8 block:
+// sads is (width/8) x (height/8), row-major; partial blocks are dropped
+void blockSad8x8(const uint8_t* a, size_t aStride, const uint8_t* b, size_t bStride,
+                 int width, int height, uint32_t* sads);
+
+// Name of the implementation in use, e.g. for the startup log
+const char* pixelKernelsImplementation();
+
+// Names of the implementations this CPU supports, fastest first and "scalar"
+// last; fills at most maxNames and returns how many there are
+int pixelKernelsSupported(const char** names, int maxNames);
+
+// Switch to one of the supported implementations, for tests and benchmarks;
+// returns false (keeping the current one) for any other name. Not safe while
+// another thread is running a kernel.
+bool pixelKernelsSelect(const char* name);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Pupil location within an equalized grayscale eye crop: Hough circles are
+// the candidates and the darkest of them is taken as the pupil. Kept apart
+// from the detection services so `make bench` can time it on its own.
+
+// Candidate circles, with the Hough parameters tuned for eye crops
+void findPupilCandidates(const cv::Mat& eye, std::vector<cv::Vec3f>& circles);
+
+// Pick the darkest circle, i.e. the one with the smallest pixel sum, as the
+// pupil. Circles that fall entirely outside the crop are ignored; returns
+// false when none is left. table is scratch space for the summed-area table.
+bool eyeBallDetection(const cv::Mat& eye, const std::vector<cv::Vec3f>& circles, cv::Vec3f& eyeball,
+                      cv::Mat& table);
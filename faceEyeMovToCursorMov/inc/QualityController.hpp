@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct QualityControlConfig {
+    uint32_t encodeBudgetUs = 20000; // Per-frame encode time to stay under
+    uint32_t bitrateKbps = 0;        // Output bitrate to stay under, 0 = no limit
+    int maxQuality = 80;
+    int minQuality = 50;
+    int qualityStep = 10;
+    int maxDownscale = 4;            // 1, 2 or 4
+};
+
+struct EncodeSettings {
+    int quality;
+    int downscale; // 1 = full, 2 = half, 4 = quarter resolution
+};
+
+// Picks JPEG quality and resolution from the measured cost of the frames
+// encoded so far. The settings form a ladder from best (max quality, full
+// size) to cheapest: quality drops first, then the resolution halves and
+// quality starts over at the top. The controller steps down after a few
+// frames over budget and only steps back up after a long run comfortably
+// under it, so it does not oscillate around the limit. A step up that has to
+// be taken back soon after doubles the wait before the next attempt.
+class QualityController
+{
+public:
+    explicit QualityController(const QualityControlConfig& config = {}) { configure(config); }
+
+    void configure(const QualityControlConfig& config);
+
+    EncodeSettings settings() const;
+
+    // Cost of the frame just encoded with settings(). Returns true if the
+    // settings for the next frame changed.
+    bool update(uint64_t encodeUs, size_t bytes, uint64_t timestampNs);
+
+    // Smoothed measurements at the current settings
+    double encodeTimeUs() const { return _encodeUs; }
+    double bitrateKbps() const { return _kbps; }
+
+private:
+    static constexpr double SMOOTHING = 0.2;    // EWMA weight of the newest frame
+    static constexpr double LOW_WATER = 0.7;    // Fraction of a limit counted as comfortably under
+    static constexpr int STEP_DOWN_FRAMES = 3;  // Consecutive frames over a limit before stepping down
+    static constexpr int STEP_UP_FRAMES = 30;   // Consecutive frames under low water before stepping up
+    static constexpr int MAX_STEP_UP_FRAMES = 30 * 32;
+
+    QualityControlConfig _config;
+    int _qualityLevels = 1;
+    int _levels = 1;
+    int _level = 0;
+
+    bool _reseed = true;       // Next sample replaces the averages (new settings)
+    uint64_t _lastNs = 0;
+    double _encodeUs = 0.0;
+    double _bytes = 0.0;
+    double _intervalS = 0.0;
+    double _kbps = 0.0;
+    int _overFrames = 0;
+    int _underFrames = 0;
+    int _stepUpFrames = STEP_UP_FRAMES; // Current wait before stepping up
+    int _sinceStepUp = 0;               // Frames since the last step up
+    bool _steppedUp = false;
+};
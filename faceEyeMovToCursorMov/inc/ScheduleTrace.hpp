@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "TimeUtils.hpp"
+
+// Optional trace of the real-time schedule: every service release and
+// execution, and every frame's time in each pipeline stage, recorded into a
+// buffer allocated up front and written out at exit as Chrome trace JSON
+// (open it in Perfetto or chrome://tracing). Executions appear once per
+// service and once under the CPU they ran on, so the interleaving on each
+// core can be read off directly. When the buffer is full, later events are
+// counted and dropped.
+//
+// Disabled, each trace point costs one predictable branch on
+// schedule_trace_enabled, which is only written by scheduleTraceInit before
+// any service thread starts.
+
+enum class TraceKind : uint8_t {
+    Release,          // Release queued for a service
+    ReleaseSkipped,   // Release dropped by SkipNext
+    ReleaseCoalesced, // Release merged into a pending one
+    Execution,        // Service ran; arg is its scheduled release (0 if unknown)
+    Stage,            // Frame spent this long in a pipeline stage; arg is the frame id
+};
+
+enum class TraceGroup : uint8_t {
+    Services,
+    Frames,
+};
+
+extern bool schedule_trace_enabled;
+
+// Name a track (a row in the viewer); returns its id. name must outlive the
+// trace. Only valid before scheduleTraceInit; a full table returns track 0.
+uint16_t scheduleTraceTrack(const char* name, TraceGroup group);
+
+// Allocate and prefault room for capacity events and start recording
+bool scheduleTraceInit(size_t capacity);
+
+// Write the trace to path as JSON and release the buffer. Only valid once
+// every thread that records has stopped.
+void scheduleTraceDeinit(const std::string& path);
+
+void scheduleTraceRecord(TraceKind kind, uint16_t track, uint64_t startNs, uint64_t endNs, uint64_t arg);
+
+inline void traceInstant(TraceKind kind, uint16_t track, uint64_t arg = 0)
+{
+    if (schedule_trace_enabled) [[unlikely]] {
+        uint64_t now = monotonicNowNs();
+        scheduleTraceRecord(kind, track, now, now, arg);
+    }
+}
+
+inline void traceSpan(TraceKind kind, uint16_t track, uint64_t startNs, uint64_t endNs, uint64_t arg = 0)
+{
+    if (schedule_trace_enabled) [[unlikely]] {
+        scheduleTraceRecord(kind, track, startNs, endNs, arg);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// On-disk layout of a recording, shared with the recordingReader tool. Each
+// segment is a pair of append-only files:
+//   segment_<n>.mjpg  JPEG images back to back, nothing in between
+//   segment_<n>.idx   SegmentIndexHeader, then one SegmentIndexEntry per image
+// An index entry is written after its image, so every indexed image is
+// complete even if the recorder died mid-write; a torn last entry is ignored.
+// Fields are in host (little-endian) byte order.
+
+static constexpr char SEGMENT_INDEX_MAGIC[8] = {'F', 'E', 'M', 'J', 'I', 'D', 'X', '1'};
+static constexpr uint32_t SEGMENT_INDEX_VERSION = 1;
+
+struct SegmentIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t segment;   // Sequence number, also in the file names
+    uint64_t createdNs; // CLOCK_MONOTONIC when the segment was opened
+};
+
+struct SegmentIndexEntry {
+    uint64_t frameId;
+    uint64_t timestampNs; // CLOCK_MONOTONIC capture time of the frame
+    uint64_t offset;      // Byte offset of the JPEG in the .mjpg file
+    uint32_t size;        // JPEG size in bytes
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SegmentIndexHeader) == 24, "index header layout changed");
+static_assert(sizeof(SegmentIndexEntry) == 32, "index entry layout changed");
+
+// <directory>/segment_<6-digit number>.<extension>
+inline std::string segmentFileName(const std::string& directory, uint32_t segment, const char* extension)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "segment_%06u.%s", segment, extension);
+    return directory + "/" + name;
+}
@@ -16,10 +16,104 @@
 #include <vector>
 #include <semaphore.h>
 #include <atomic>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <cmath>
+#include <limits>
+#include <cerrno>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "CpuTopology.hpp"
+#include "Histogram.hpp"
+#include "Metrics.hpp"
+#include "ScheduleTrace.hpp"
+#include "SpscRing.hpp"
+#include "TimeUtils.hpp"
+
+
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+// Layout of the kernel's struct sched_attr (SCHED_ATTR_SIZE_VER0); glibc
+// does not wrap sched_setattr() so we call the syscall directly
+struct DeadlineSchedAttr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;  // ns
+    uint64_t sched_deadline; // ns
+    uint64_t sched_period;   // ns
+};
+
+// How the sequencer assigns scheduling parameters to services
+enum class SchedulingMode : uint8_t {
+    Fixed,         // SCHED_FIFO with the priorities given to addService()
+    RateMonotonic, // SCHED_FIFO with priorities derived from the periods
+    Deadline       // SCHED_DEADLINE from declared budgets, RM FIFO as fallback
+};
+
+// Where the sequencer runs services
+enum class PlacementMode : uint8_t {
+    Fixed,    // On the CPUs given to addService() / setAffinity()
+    Automatic // From the CPU topology, by service class and declared utilization
+};
+
+// What automatic placement optimizes a service for
+enum class ServiceClass : uint8_t {
+    LatencyCritical, // Part of the capture-to-cursor chain: isolated CPUs, one each
+    Batch            // Throughput work: shares whatever the critical chain does not use
+};
 
+// What a service does with a release that arrives while it is still busy
+// with (or still has pending) earlier work. Deadlines default to periods.
+enum class OverrunPolicy : uint8_t {
+    RunToCompletion, // Queue every release (up to 64); the service catches up in a burst
+    SkipNext,        // Drop releases that arrive while the service is running
+    Coalesce         // Keep at most one pending release
+};
 
+// Live view of a service's counters; safe to take while the service runs
+struct ServiceStats {
+    std::string name;
+    uint32_t period;
+    uint64_t executions;
+    uint64_t deadlineMisses;
+    uint64_t skippedReleases;
+    uint64_t coalescedReleases;
+    uint32_t backlog;
+    uint32_t maxBacklog;
+    double avgExecTime;
+    double maxExecTime;
+};
 
+// Execution time, start jitter (release to start) and response time
+// (release to completion) of a service's executions, in microseconds
+struct ServiceLatency {
+    Histogram execTime;
+    Histogram startJitter;
+    Histogram responseTime;
 
+    void reset()
+    {
+        execTime.reset();
+        startJitter.reset();
+        responseTime.reset();
+    }
+};
+
+struct ServiceLatencySnapshot {
+    HistogramSummary execTime;
+    HistogramSummary startJitter;
+    HistogramSummary responseTime;
+};
 
 // The service class contains the service function and service parameters
 // (priority, affinity, etc). It spawns a thread to run the service, configures
@@ -32,6 +126,12 @@ public:
 
     template<typename T>
     Service(std::string name, T&& doService, uint8_t affinity, uint8_t priority, uint32_t period) :
+        Service(std::move(name), std::forward<T>(doService), CpuSet::single(affinity), priority, period)
+    {
+    }
+
+    template<typename T>
+    Service(std::string name, T&& doService, const CpuSet& affinity, uint8_t priority, uint32_t period) :
         _doService(doService)
     {
         // store service configuration values
@@ -42,15 +142,29 @@ public:
         _isRunning = true;
         // initialize release semaphore
         sem_init(&_releaseSem, 0, 0); 
-        // Start the service thread, which will begin running the given function immediately
+        _traceTrack = scheduleTraceTrack(service_name.c_str(), TraceGroup::Services);
+    }
+
+    // Start the service thread, which configures itself and then waits for
+    // releases. Scheduling parameters must be final by now.
+    void start(){
         _service = std::jthread(&Service::_provideService, this);
     }
  
-    void stop(){
+    // Stop and join the service thread without tearing anything down, so
+    // other services may still notify() this one until they are halted too
+    void halt(){
         // change state to "not running" using an atomic variable
         _isRunning = false;
         sem_post(&_releaseSem);
         _service.request_stop(); 
+        if (_service.joinable()) {
+            _service.join();
+        }
+    }
+
+    void stop(){
+        halt();
         sem_destroy(&_releaseSem);
 
         // Log execution statistics
@@ -60,14 +174,171 @@ public:
         // (heads up: what if the service is waiting on the semaphore when this happens?)
     }
  
-    void release(){
+    // Called by the sequencer's dispatcher thread: scheduledNs is the ideal
+    // release time on CLOCK_MONOTONIC, releaseNs when it actually got there
+    void release(uint64_t scheduledNs, uint64_t releaseNs){
+        double releaseJitter = (releaseNs - scheduledNs) / 1e6;
+        _minReleaseJitter = std::min(_minReleaseJitter, releaseJitter);
+        _maxReleaseJitter = std::max(_maxReleaseJitter, releaseJitter);
+        _post(scheduledNs);
+    }
+
+    // Called by the producer of a data-triggered service's input whenever it
+    // queues something. The oldest unserved arrival takes the place of the
+    // scheduled release, so start jitter and deadline misses measure the
+    // pipeline delay. Safe to call from several producer threads.
+    void notify(){
+        if (_dataTriggered && _isRunning.load(std::memory_order_relaxed)) {
+            _post(monotonicNowNs());
+        }
+    }
+
+    // Release the service when its input has new data (see notify()) instead
+    // of from the periodic schedule. minIntervalMs rate-limits the service:
+    // a release is held until that long after the previous start. The period
+    // still sets the deadline and the rate-monotonic priority.
+    Service& triggerOnData(uint32_t minIntervalMs = 0)
+    {
+        _dataTriggered = true;
+        _minIntervalNs = static_cast<uint64_t>(minIntervalMs) * 1'000'000ULL;
+        return *this;
+    }
+
+    bool isDataTriggered() const { return _dataTriggered; }
+
+private:
+    void _post(uint64_t scheduledNs){
+        // Apply the overrun policy and claim the pending slot in one step:
+        // notify() may post from several threads at once, so a check on
+        // _pending followed by a separate increment could let two releases
+        // through where the policy allows one
+        uint32_t pending = 0;
+        switch (_overrunPolicy.load(std::memory_order_relaxed)) {
+        case OverrunPolicy::SkipNext:
+            if (_busy.load(std::memory_order_acquire)
+                || !_pending.compare_exchange_strong(pending, 1, std::memory_order_acq_rel)) {
+                _skippedReleases.fetch_add(1, std::memory_order_relaxed);
+                traceInstant(TraceKind::ReleaseSkipped, _traceTrack);
+                return;
+            }
+            pending = 1;
+            break;
+        case OverrunPolicy::Coalesce:
+            if (!_pending.compare_exchange_strong(pending, 1, std::memory_order_acq_rel)) {
+                _coalescedReleases.fetch_add(1, std::memory_order_relaxed);
+                traceInstant(TraceKind::ReleaseCoalesced, _traceTrack);
+                return;
+            }
+            pending = 1;
+            break;
+        case OverrunPolicy::RunToCompletion:
+            // Queue up to as many releases as there are slots for their
+            // scheduled times; beyond that a release would run without one
+            // and every later execution would be paired with the wrong time
+            pending = _pending.load(std::memory_order_acquire);
+            do {
+                if (pending == MAX_RELEASE_BACKLOG) {
+                    _skippedReleases.fetch_add(1, std::memory_order_relaxed);
+                    traceInstant(TraceKind::ReleaseSkipped, _traceTrack);
+                    return;
+                }
+            } while (!_pending.compare_exchange_weak(pending, pending + 1, std::memory_order_acq_rel));
+            ++pending;
+            break;
+        }
+        if (pending > _maxBacklog.load(std::memory_order_relaxed)) {
+            _maxBacklog.store(pending, std::memory_order_relaxed);
+        }
+
+        // Hand the scheduled time to the service thread so it can measure its
+        // start jitter and response time
+        if (_dataTriggered) {
+            uint64_t none = 0;
+            _firstArrivalNs.compare_exchange_strong(none, scheduledNs, std::memory_order_acq_rel);
+        } else {
+            _releaseTimes.push(scheduledNs);
+        }
+
         // release the service using the semaphore
- 
+        traceInstant(TraceKind::Release, _traceTrack);
         if(sem_post(&_releaseSem)!=0)
         {
             printf("Error %d\n",_period);
         }
     }
+
+public:
+
+    Service& setOverrunPolicy(OverrunPolicy policy)
+    {
+        _overrunPolicy.store(policy, std::memory_order_relaxed);
+        return *this;
+    }
+
+    // Declare the worst-case execution time per release and, optionally, a
+    // relative deadline shorter than the period (0 = implicit deadline)
+    Service& setBudget(uint32_t runtimeUs, uint32_t deadlineMs = 0)
+    {
+        _runtimeUs = runtimeUs;
+        _deadlineMs = deadlineMs;
+        return *this;
+    }
+
+    uint32_t getRuntimeUs() const { return _runtimeUs; }
+    uint32_t getDeadline() const { return _deadlineMs ? _deadlineMs : _period; }
+    const CpuSet& getAffinity() const { return _affinity; }
+
+    // CPUs the service thread may run on; only valid before it is started
+    Service& setAffinity(const CpuSet& affinity)
+    {
+        _affinity = affinity;
+        return *this;
+    }
+
+    Service& setServiceClass(ServiceClass serviceClass)
+    {
+        _serviceClass = serviceClass;
+        return *this;
+    }
+
+    ServiceClass getServiceClass() const { return _serviceClass; }
+    double getUtilization() const { return _period ? _runtimeUs / (_period * 1000.0) : 0.0; }
+
+    void setPriority(uint8_t priority) { _priority = priority; }
+    uint8_t getPriority() const { return _priority; }
+
+    // Run under SCHED_DEADLINE; the FIFO priority stays as the fallback
+    void useDeadlineScheduling(bool enable) { _useDeadline = enable; }
+
+    // Latency over the whole run, e.g. for the metrics socket
+    const ServiceLatency& latency() const { return _latency; }
+
+    // Latency since the previous snapshot, then start a new window. An
+    // execution finishing during the call may be left out of both windows
+    // (it still counts for the whole run).
+    ServiceLatencySnapshot snapshotLatency()
+    {
+        ServiceLatencySnapshot snapshot = {_window.execTime.summary(), _window.startJitter.summary(),
+                                           _window.responseTime.summary()};
+        _window.reset();
+        return snapshot;
+    }
+
+    ServiceStats getStats() const
+    {
+        ServiceStats stats;
+        stats.name = service_name;
+        stats.period = _period;
+        stats.executions = _executionCount.load(std::memory_order_relaxed);
+        stats.deadlineMisses = _deadlineMisses.load(std::memory_order_relaxed);
+        stats.skippedReleases = _skippedReleases.load(std::memory_order_relaxed);
+        stats.coalescedReleases = _coalescedReleases.load(std::memory_order_relaxed);
+        stats.backlog = _pending.load(std::memory_order_relaxed);
+        stats.maxBacklog = _maxBacklog.load(std::memory_order_relaxed);
+        stats.avgExecTime = stats.executions ? _totalExecTime.load(std::memory_order_relaxed) / stats.executions : 0.0;
+        stats.maxExecTime = _maxExecTime.load(std::memory_order_relaxed);
+        return stats;
+    }
  
 private:
     std::function<void(void)> _doService;
@@ -76,31 +347,87 @@ private:
     std::atomic<bool> _isRunning; // Changed to std::atomic<bool>
 
 
-    uint8_t _affinity;
+    CpuSet _affinity;
+    ServiceClass _serviceClass = ServiceClass::LatencyCritical;
     uint8_t _priority;
     uint32_t _period;
-
-    // Timing statistics
-    std::chrono::high_resolution_clock::time_point _lastStartTime;
-    double _minExecTime = std::numeric_limits<double>::max();
-    double _maxExecTime = 0.0;
-    double _totalExecTime = 0.0;
-    int _executionCount = 0;
-
+    uint32_t _runtimeUs = 0;
+    uint32_t _deadlineMs = 0;
+    bool _useDeadline = false;
+
+    // Data-triggered releases
+    bool _dataTriggered = false;
+    uint64_t _minIntervalNs = 0;
+    uint64_t _lastStartNs = 0;
+
+    // Scheduled release times not yet picked up by the service thread; a
+    // data-triggered service only keeps its oldest unserved arrival
+    static constexpr uint32_t MAX_RELEASE_BACKLOG = 64;
+    SpscRing<uint64_t, MAX_RELEASE_BACKLOG> _releaseTimes;
+    std::atomic<uint64_t> _firstArrivalNs{0};
+
+    // Overrun handling
+    std::atomic<OverrunPolicy> _overrunPolicy{OverrunPolicy::RunToCompletion};
+    std::atomic<bool> _busy{false};
+    std::atomic<uint32_t> _pending{0};  // Releases posted but not yet started
+    std::atomic<uint32_t> _maxBacklog{0};
+    std::atomic<uint64_t> _deadlineMisses{0};
+    std::atomic<uint64_t> _skippedReleases{0};
+    std::atomic<uint64_t> _coalescedReleases{0};
+
+    // Timing statistics (written by the service thread, readable live)
+    std::atomic<double> _minExecTime{std::numeric_limits<double>::max()};
+    std::atomic<double> _maxExecTime{0.0};
+    std::atomic<double> _totalExecTime{0.0};
+    std::atomic<uint64_t> _executionCount{0};
+
+    uint16_t _traceTrack = 0; // Row in the schedule trace
+
+    // Percentiles for the whole run and for the current snapshot window
+    ServiceLatency _latency;
+    ServiceLatency _window;
+
+    // Release jitter: dispatcher wake-up vs. scheduled release (dispatcher thread)
+    double _minReleaseJitter = std::numeric_limits<double>::max();
+    double _maxReleaseJitter = 0.0;
+
+    // Start jitter: service start vs. scheduled release (service thread)
     double _minStartJitter = std::numeric_limits<double>::max();
     double _maxStartJitter = 0.0;
 
 
+    bool _setDeadlineScheduling()
+    {
+        DeadlineSchedAttr attr{};
+        attr.size = sizeof(attr);
+        attr.sched_policy = SCHED_DEADLINE;
+        attr.sched_runtime = static_cast<uint64_t>(_runtimeUs) * 1000ULL;
+        attr.sched_deadline = static_cast<uint64_t>(getDeadline()) * 1'000'000ULL;
+        attr.sched_period = static_cast<uint64_t>(_period) * 1'000'000ULL;
+
+        // Deadline tasks must be allowed on the whole root domain, so the
+        // per-service affinity does not apply in this mode
+        if (syscall(SYS_sched_setattr, 0, &attr, 0) != 0) {
+            perror("sched_setattr(SCHED_DEADLINE) failed");
+            return false;
+        }
+        return true;
+    }
+
     void _initializeService()
     {
+        if (_useDeadline) {
+            if (_setDeadlineScheduling()) {
+                return;
+            }
+            std::cerr << "Service " << service_name << " falls back to SCHED_FIFO priority "
+                      << static_cast<int>(_priority) << "\n";
+        }
+
         // set affinity, priority, sched policy
         pthread_t thisThread = pthread_self();
 
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        CPU_SET(_affinity, &cpuset);
-
-        if (pthread_setaffinity_np(thisThread, sizeof(cpu_set_t), &cpuset) != 0) {
+        if (pthread_setaffinity_np(thisThread, sizeof(cpu_set_t), &_affinity.native()) != 0) {
             perror("Failed to set CPU affinity");
             return;
         }
@@ -130,35 +457,82 @@ private:
 
             if (_isRunning) {
 
-                auto start = std::chrono::high_resolution_clock::now();
+                _busy.store(true, std::memory_order_release);
+
+                // Take this release's scheduled time before giving up its
+                // pending slot, so the ring never holds more times than
+                // there are pending releases
+                uint64_t scheduled = 0;
+                if (!_dataTriggered) {
+                    _releaseTimes.pop(scheduled);
+                }
+                _pending.fetch_sub(1, std::memory_order_acq_rel);
+
+                // Rate limit: data arriving meanwhile coalesces or queues per the overrun policy
+                if (_minIntervalNs != 0 && _lastStartNs != 0) {
+                    uint64_t earliest = _lastStartNs + _minIntervalNs;
+                    if (monotonicNowNs() < earliest) {
+                        struct timespec wake = nsToTimespec(earliest);
+                        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR) {}
+                    }
+                }
 
-                // Calculate start time jitter
-                if (_executionCount > 0)
+                uint64_t start = monotonicNowNs();
+                _lastStartNs = start;
+
+                // Calculate start time jitter against the scheduled release
+                if (_dataTriggered) {
+                    scheduled = _firstArrivalNs.exchange(0, std::memory_order_acq_rel);
+                }
+                bool released = scheduled != 0 && start >= scheduled;
+                if (released)
                 {
-                    double actualInterval = std::chrono::duration<double, std::milli>(start - _lastStartTime).count();
-                    double expectedInterval = _period;
-                    double jitter = std::abs(actualInterval - expectedInterval);
-    
+                    double jitter = (start - scheduled) / 1e6;
                     _minStartJitter = std::min(_minStartJitter, jitter);
                     _maxStartJitter = std::max(_maxStartJitter, jitter);
                 }
-    
-                _lastStartTime = start;
 
                 _doService();
 
-                auto end = std::chrono::high_resolution_clock::now();
-                double execTime = std::chrono::duration<double, std::milli>(end - start).count();
+                uint64_t end = monotonicNowNs();
+                traceSpan(TraceKind::Execution, _traceTrack, start, end, scheduled);
+                double execTime = (end - start) / 1e6;
+
+                // The response must complete within the deadline (the period
+                // unless setBudget() constrained it) of the release
+                if (scheduled != 0 && end - scheduled > static_cast<uint64_t>(getDeadline()) * 1'000'000ULL) {
+                    _deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+                }
+                _busy.store(false, std::memory_order_release);
     
-                _minExecTime = std::min(_minExecTime, execTime);
-                _maxExecTime = std::max(_maxExecTime, execTime);
-                _totalExecTime += execTime;
-                _executionCount++;
+                _minExecTime.store(std::min(_minExecTime.load(std::memory_order_relaxed), execTime), std::memory_order_relaxed);
+                _maxExecTime.store(std::max(_maxExecTime.load(std::memory_order_relaxed), execTime), std::memory_order_relaxed);
+                _totalExecTime.store(_totalExecTime.load(std::memory_order_relaxed) + execTime, std::memory_order_relaxed);
+                _executionCount.fetch_add(1, std::memory_order_relaxed);
+
+                uint64_t execUs = (end - start) / 1000;
+                for (ServiceLatency* latency : {&_latency, &_window}) {
+                    latency->execTime.record(execUs);
+                    if (released) {
+                        latency->startJitter.record((start - scheduled) / 1000);
+                        latency->responseTime.record((end - scheduled) / 1000);
+                    }
+                }
             }
         }
         
     }
 
+    static void _logPercentiles(const char* what, const Histogram& histogram)
+    {
+        if (histogram.count() == 0) {
+            return;
+        }
+        HistogramSummary s = histogram.summary();
+        std::printf("  %s p50/p90/p99/p99.9/max: %.3f / %.3f / %.3f / %.3f / %.3f ms\n", what,
+                    s.p50 / 1000.0, s.p90 / 1000.0, s.p99 / 1000.0, s.p999 / 1000.0, s.max / 1000.0);
+    }
+
     void logStatistics()
     {
         if (_executionCount == 0)
@@ -167,19 +541,35 @@ private:
             return;
         }
 
-        double avgExecTime = _totalExecTime / _executionCount;
-        double execJitter = _maxExecTime - _minExecTime;
+        ServiceStats stats = getStats();
+        double minExecTime = _minExecTime.load(std::memory_order_relaxed);
+        double execJitter = stats.maxExecTime - minExecTime;
         double startJitter = _maxStartJitter - _minStartJitter;
+        double releaseJitter = _maxReleaseJitter - _minReleaseJitter;
 
         std::cout << "Service Stats (Period: " << _period << " ms):\n";
         std::cout << "Service Name " << service_name.c_str() << "\n";
-        std::cout << "  Min Execution Time: " << _minExecTime << " ms\n";
-        std::cout << "  Max Execution Time: " << _maxExecTime << " ms\n";
-        std::cout << "  Avg Execution Time: " << avgExecTime << " ms\n";
+        std::cout << "  Min Execution Time: " << minExecTime << " ms\n";
+        std::cout << "  Max Execution Time: " << stats.maxExecTime << " ms\n";
+        std::cout << "  Avg Execution Time: " << stats.avgExecTime << " ms\n";
         std::cout << "  Execution Time Jitter: " << execJitter << " ms\n";
+        _logPercentiles("Execution Time", _latency.execTime);
+        if (_dataTriggered) {
+            std::cout << "  Released on data, min interval " << _minIntervalNs / 1e6 << " ms\n";
+        } else {
+            std::cout << "  Min Release Jitter: " << _minReleaseJitter << " ms\n";
+            std::cout << "  Max Release Jitter: " << _maxReleaseJitter << " ms\n";
+            std::cout << "  Release Jitter: " << releaseJitter << " ms\n";
+        }
         std::cout << "  Min Start Time Jitter: " << _minStartJitter << " ms\n";
         std::cout << "  Max Start Time Jitter: " << _maxStartJitter << " ms\n";
         std::cout << "  Start Time Jitter: " << startJitter << " ms\n";
+        _logPercentiles("Start Time Jitter", _latency.startJitter);
+        _logPercentiles("Response Time", _latency.responseTime);
+        std::cout << "  Deadline Misses: " << stats.deadlineMisses << "\n";
+        std::cout << "  Skipped Releases: " << stats.skippedReleases << "\n";
+        std::cout << "  Coalesced Releases: " << stats.coalescedReleases << "\n";
+        std::cout << "  Max Release Backlog: " << stats.maxBacklog << "\n";
     }
 };
  
@@ -189,62 +579,182 @@ private:
 
 
 // The sequencer class contains the services set and manages
-// starting/stopping the services. While the services are running,
-// the sequencer releases each service at the requisite timepoint.
+// starting/stopping the services. While the services are running, a single
+// dispatcher thread releases each service at the requisite timepoint.
+//
+// Release times are computed up front for one hyperperiod (the LCM of all
+// periods) as offsets from a common CLOCK_MONOTONIC origin, so neither
+// timer drift nor wall-clock adjustments move the schedule. The dispatcher
+// sleeps with clock_nanosleep(TIMER_ABSTIME) until the next release and
+// releases services due at the same instant in rate-monotonic order.
+//
+// In Deadline mode each service runs under SCHED_DEADLINE with its declared
+// runtime/deadline/period once the whole set passes an admission test; if it
+// does not (or a budget is missing) every service gets SCHED_FIFO with
+// rate-monotonic priorities instead. Note that SCHED_DEADLINE tasks rank
+// above the FIFO dispatcher, bounded by their budgets.
+//
+// Data-triggered services (Service::triggerOnData) are left out of the
+// schedule; their producers release them through Service::notify().
 
 class Sequencer
 {
 public:
     template<typename... Args>
-    void addService(Args&&... args)
+    Service& addService(Args&&... args)
     {
         _services.emplace_back(std::make_unique<Service>(std::forward<Args>(args)...));
-        
+        return *_services.back();
     }
 
-    void startServices()
+    // Live counters of every service, e.g. for periodic reporting while running
+    std::vector<ServiceStats> getStats() const
     {
+        std::vector<ServiceStats> stats;
         for (auto& svc : _services) {
-            timer_t timerId;
-
-            struct sigevent sev{};
-            sev.sigev_notify = SIGEV_THREAD;
-            sev.sigev_value.sival_ptr = svc.get();
-            sev.sigev_notify_function = [](union sigval val) {
-                auto* s = static_cast<Service*>(val.sival_ptr);
-                s->release();
-            };
-
-            if (timer_create(CLOCK_REALTIME, &sev, &timerId) != 0) {
-                perror("Failed to create timer");
+            stats.push_back(svc->getStats());
+        }
+        return stats;
+    }
+
+    // Counters since startup and percentiles since the previous call
+    void logLiveStatistics()
+    {
+        for (auto& svc : _services) {
+            ServiceStats stats = svc->getStats();
+            ServiceLatencySnapshot latency = svc->snapshotLatency();
+            std::printf("%-26s runs %llu, avg %.2f ms, max %.2f ms, missed %llu, skipped %llu, coalesced %llu, backlog %u (max %u)\n",
+                        stats.name.c_str(), static_cast<unsigned long long>(stats.executions),
+                        stats.avgExecTime, stats.maxExecTime,
+                        static_cast<unsigned long long>(stats.deadlineMisses),
+                        static_cast<unsigned long long>(stats.skippedReleases),
+                        static_cast<unsigned long long>(stats.coalescedReleases),
+                        stats.backlog, stats.maxBacklog);
+            if (latency.execTime.count == 0) {
                 continue;
             }
+            std::printf("%-26s   last %llu runs: exec p50 %.2f p99 %.2f p99.9 %.2f ms",
+                        "", static_cast<unsigned long long>(latency.execTime.count),
+                        latency.execTime.p50 / 1000.0, latency.execTime.p99 / 1000.0, latency.execTime.p999 / 1000.0);
+            if (latency.responseTime.count > 0) {
+                std::printf(", start jitter p99 %.2f ms, response p50 %.2f p99 %.2f p99.9 %.2f ms",
+                            latency.startJitter.p99 / 1000.0, latency.responseTime.p50 / 1000.0,
+                            latency.responseTime.p99 / 1000.0, latency.responseTime.p999 / 1000.0);
+            }
+            std::printf("\n");
+        }
+    }
+
+    // Per-service counters for the metrics socket, one metric at a time
+    // across all services as the text format requires
+    void collectMetrics(MetricsWriter& out) const
+    {
+        std::vector<ServiceStats> stats = getStats();
+        std::vector<std::string> labels;
+        for (const ServiceStats& s : stats) {
+            labels.push_back("service=\"" + s.name + "\"");
+        }
+        for (size_t i = 0; i < stats.size(); ++i) {
+            out.counter("femc_service_executions_total", "Completed service executions",
+                        stats[i].executions, labels[i].c_str());
+        }
+        for (size_t i = 0; i < stats.size(); ++i) {
+            out.counter("femc_service_exec_seconds_total", "Time spent executing the service",
+                        stats[i].avgExecTime * stats[i].executions / 1000.0, labels[i].c_str());
+        }
+        for (size_t i = 0; i < stats.size(); ++i) {
+            out.gauge("femc_service_exec_max_seconds", "Longest service execution",
+                      stats[i].maxExecTime / 1000.0, labels[i].c_str());
+        }
+        for (size_t i = 0; i < stats.size(); ++i) {
+            out.counter("femc_service_deadline_misses_total", "Executions that finished past their deadline",
+                        stats[i].deadlineMisses, labels[i].c_str());
+        }
+        for (size_t i = 0; i < stats.size(); ++i) {
+            out.counter("femc_service_skipped_releases_total", "Releases dropped while the service overran",
+                        stats[i].skippedReleases, labels[i].c_str());
+        }
+        for (size_t i = 0; i < stats.size(); ++i) {
+            out.counter("femc_service_coalesced_releases_total", "Releases merged into a pending one",
+                        stats[i].coalescedReleases, labels[i].c_str());
+        }
+        for (size_t i = 0; i < stats.size(); ++i) {
+            out.gauge("femc_service_backlog", "Releases posted but not yet started",
+                      stats[i].backlog, labels[i].c_str());
+        }
+        for (size_t i = 0; i < _services.size(); ++i) {
+            out.summary("femc_service_execution_seconds", "Service execution time",
+                        _services[i]->latency().execTime, 1e-6, labels[i].c_str());
+        }
+        for (size_t i = 0; i < _services.size(); ++i) {
+            out.summary("femc_service_start_jitter_seconds", "Delay from release to the start of execution",
+                        _services[i]->latency().startJitter, 1e-6, labels[i].c_str());
+        }
+        for (size_t i = 0; i < _services.size(); ++i) {
+            out.summary("femc_service_response_seconds", "Time from release to the end of execution",
+                        _services[i]->latency().responseTime, 1e-6, labels[i].c_str());
+        }
+        for (size_t i = 0; i < stats.size(); ++i) {
+            out.gauge("femc_service_backlog_max", "Largest backlog seen", stats[i].maxBacklog, labels[i].c_str());
+        }
+    }
 
-            // Set periodic interval based on svc.getPeriod()
-            struct itimerspec its{};
-            int period_ms = svc->getPeriod();
+    // Must be called before startServices()
+    void setSchedulingMode(SchedulingMode mode) { _mode = mode; }
+    void setPlacementMode(PlacementMode mode) { _placement = mode; }
 
-            its.it_value.tv_sec = period_ms / 1000;
-            its.it_value.tv_nsec = (period_ms % 1000) * 1'000'000;
-            its.it_interval = its.it_value; // make it periodic
+    void startServices()
+    {
+        if (_placement == PlacementMode::Automatic) {
+            _placeServices();
+        }
 
-            if (timer_settime(timerId, 0, &its, nullptr) != 0) {
-                perror("Failed to start timer");
-                timer_delete(timerId); // clean up if failed
-                continue;
+        switch (_mode) {
+        case SchedulingMode::Fixed:
+            break;
+        case SchedulingMode::RateMonotonic:
+            _assignRateMonotonicPriorities();
+            _checkRateMonotonicBound();
+            break;
+        case SchedulingMode::Deadline:
+            // RM priorities double as the fallback if a thread cannot switch policy
+            _assignRateMonotonicPriorities();
+            if (_admitDeadlineSet()) {
+                for (auto& svc : _services) {
+                    svc->useDeadlineScheduling(true);
+                }
+            } else {
+                std::cerr << "Deadline admission failed, using rate-monotonic SCHED_FIFO\n";
+                _checkRateMonotonicBound();
             }
+            break;
+        }
 
-            _timerIds.push_back(timerId);
+        _logPlacement();
+        for (auto& svc : _services) {
+            svc->start();
+        }
+
+        _buildSchedule();
+        if (_schedule.empty()) {
+            return;
         }
+        _dispatcher = std::jthread([this](std::stop_token stopToken) { _dispatch(stopToken); });
     }
 
     void stopServices()
     {
-        // Stop all timers
-        for (auto& timer : _timerIds) {
-            timer_delete(timer);
+        // Stop the dispatcher first so no release races with the shutdown
+        if (_dispatcher.joinable()) {
+            _dispatcher.request_stop();
+            _dispatcher.join();
+        }
+
+        // Halt every thread before any semaphore goes away: a data-triggered
+        // service is released from its producer's thread
+        for (auto& svc : _services) {
+            svc->halt();
         }
-        _timerIds.clear();
 
         // Stop all services
         for (auto& svc : _services) {
@@ -253,6 +763,255 @@ public:
     }
 
 private:
+    // One release of one service, at offsetNs into the hyperperiod
+    struct ScheduledRelease {
+        uint64_t offsetNs;
+        Service* service;
+    };
+
+    // Share of each CPU SCHED_DEADLINE may hand out (kernel default sched_rt_runtime_us/period_us)
+    static constexpr double DEADLINE_BANDWIDTH = 0.95;
+
     std::vector<std::unique_ptr<Service>> _services;
-    std::vector<timer_t> _timerIds;
+    SchedulingMode _mode = SchedulingMode::Fixed;
+    PlacementMode _placement = PlacementMode::Fixed;
+    std::vector<ScheduledRelease> _schedule;
+    uint64_t _hyperperiodNs = 0;
+    std::jthread _dispatcher;
+
+    // Shorter period => higher priority, counting down from just below the
+    // dispatcher; services with equal periods share a priority
+    void _assignRateMonotonicPriorities()
+    {
+        std::vector<Service*> byPeriod;
+        for (auto& svc : _services) {
+            byPeriod.push_back(svc.get());
+        }
+        std::stable_sort(byPeriod.begin(), byPeriod.end(), [](Service* a, Service* b) {
+            if (a->getPeriod() != b->getPeriod()) {
+                return a->getPeriod() < b->getPeriod();
+            }
+            return a->getDeadline() < b->getDeadline();
+        });
+
+        int priority = sched_get_priority_max(SCHED_FIFO) - 1;
+        int minPriority = sched_get_priority_min(SCHED_FIFO);
+        for (size_t i = 0; i < byPeriod.size(); ++i) {
+            if (i > 0 && byPeriod[i]->getPeriod() != byPeriod[i - 1]->getPeriod() && priority > minPriority) {
+                --priority;
+            }
+            byPeriod[i]->setPriority(static_cast<uint8_t>(priority));
+            std::cout << "RM priority " << priority << " for " << byPeriod[i]->service_name
+                      << " (period " << byPeriod[i]->getPeriod() << " ms)\n";
+        }
+    }
+
+    // Liu & Layland utilization bound per core; sufficient, not necessary,
+    // so exceeding it is only a warning. Services sharing a set of several
+    // CPUs are only checked against its capacity, as no such bound applies.
+    void _checkRateMonotonicBound() const
+    {
+        std::vector<CpuSet> sets;
+        for (auto& svc : _services) {
+            if (std::find(sets.begin(), sets.end(), svc->getAffinity()) == sets.end()) {
+                sets.push_back(svc->getAffinity());
+            }
+        }
+
+        for (const CpuSet& set : sets) {
+            double utilization = 0.0;
+            int count = 0;
+            for (auto& svc : _services) {
+                if (svc->getAffinity() == set && svc->getRuntimeUs() > 0) {
+                    utilization += svc->getUtilization();
+                    ++count;
+                }
+            }
+            if (count == 0) {
+                continue;
+            }
+            double bound = set.count() == 1 ? count * (std::pow(2.0, 1.0 / count) - 1.0) : set.count();
+            std::cout << "CPUs " << set.toString() << " utilization " << utilization
+                      << (set.count() == 1 ? " (RM bound " : " (capacity ") << bound << ")\n";
+            if (utilization > bound) {
+                std::cerr << "Warning: CPUs " << set.toString()
+                          << (set.count() == 1 ? " exceed the rate-monotonic utilization bound\n"
+                                               : " are overloaded\n");
+            }
+        }
+    }
+
+    // Latency-critical services go to the isolated CPUs (isolcpus= or
+    // nohz_full=), using one hardware thread per physical core so no SMT
+    // sibling competes with them. Heaviest declared utilization first, each
+    // is pinned to the least loaded of those CPUs, which keeps the
+    // rate-monotonic analysis per core. Batch services share every other
+    // CPU and the kernel balances them. Without isolated CPUs the first
+    // allowed CPU is left to the kernel and batch work.
+    void _placeServices()
+    {
+        CpuTopology topology;
+        if (!readCpuTopology(topology)) {
+            std::cerr << "No usable CPUs found, keeping the fixed placement\n";
+            return;
+        }
+
+        // isolcpus= also takes CPUs out of the default affinity mask, so the
+        // isolated set is not limited to the CPUs we were started on
+        CpuSet pool = (topology.isolated | topology.nohzFull) & topology.online;
+        const char* source = "isolated";
+        if (pool.empty()) {
+            pool = topology.allowed;
+            if (pool.count() > 1) {
+                pool.remove(pool.first());
+            }
+            source = "no CPUs isolated";
+        }
+        CpuSet batch = topology.allowed - pool;
+        if (batch.empty()) {
+            batch = topology.allowed;
+        }
+        CpuSet critical = pool & topology.primary;
+        if (critical.empty()) {
+            critical = pool;
+        }
+
+        std::vector<unsigned> cpus;
+        for (unsigned cpu = critical.first(); cpu < CPU_SETSIZE; ++cpu) {
+            if (critical.contains(cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
+        std::vector<double> load(cpus.size(), 0.0);
+        std::vector<int> placed(cpus.size(), 0);
+
+        std::vector<Service*> chain;
+        for (auto& svc : _services) {
+            if (svc->getServiceClass() == ServiceClass::Batch) {
+                svc->setAffinity(batch);
+            } else {
+                chain.push_back(svc.get());
+            }
+        }
+        std::stable_sort(chain.begin(), chain.end(), [](Service* a, Service* b) {
+            return a->getUtilization() > b->getUtilization();
+        });
+        for (Service* svc : chain) {
+            size_t best = 0;
+            for (size_t i = 1; i < cpus.size(); ++i) {
+                if (load[i] < load[best] || (load[i] == load[best] && placed[i] < placed[best])) {
+                    best = i;
+                }
+            }
+            load[best] += svc->getUtilization();
+            placed[best]++;
+            svc->setAffinity(CpuSet::single(cpus[best]));
+        }
+
+        std::cout << "Automatic placement: latency-critical on CPUs " << critical.toString() << " (" << source
+                  << "), batch on CPUs " << batch.toString() << "\n";
+    }
+
+    void _logPlacement() const
+    {
+        std::cout << "Service placement:\n";
+        for (auto& svc : _services) {
+            std::printf("  %-26s CPUs %-8s %-16s priority %2d, utilization %.3f\n", svc->service_name.c_str(),
+                        svc->getAffinity().toString().c_str(),
+                        svc->getServiceClass() == ServiceClass::Batch ? "batch" : "latency-critical",
+                        svc->getPriority(), svc->getUtilization());
+        }
+        if (_mode == SchedulingMode::Deadline) {
+            std::cout << "  (SCHED_DEADLINE threads run on every CPU; the sets apply if they fall back to FIFO)\n";
+        }
+    }
+
+    // Every service needs a budget with runtime <= deadline <= period, and the
+    // total utilization must fit the deadline bandwidth of the online CPUs
+    bool _admitDeadlineSet() const
+    {
+        double utilization = 0.0;
+        for (auto& svc : _services) {
+            uint64_t runtimeUs = svc->getRuntimeUs();
+            if (runtimeUs == 0) {
+                std::cerr << "Service " << svc->service_name << " declares no runtime budget\n";
+                return false;
+            }
+            if (runtimeUs > svc->getDeadline() * 1000ULL || svc->getDeadline() > svc->getPeriod()) {
+                std::cerr << "Service " << svc->service_name << " needs runtime <= deadline <= period\n";
+                return false;
+            }
+            utilization += svc->getUtilization();
+        }
+
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        double capacity = DEADLINE_BANDWIDTH * (cpus > 0 ? cpus : 1);
+        std::cout << "Deadline admission: utilization " << utilization << " of " << capacity << "\n";
+        return utilization <= capacity;
+    }
+
+    void _buildSchedule()
+    {
+        _schedule.clear();
+
+        uint64_t hyperperiodMs = 1;
+        for (auto& svc : _services) {
+            if (svc->isDataTriggered()) {
+                continue;
+            }
+            if (svc->getPeriod() == 0) {
+                std::cerr << "Service " << svc->service_name << " has no period, not scheduled\n";
+                continue;
+            }
+            hyperperiodMs = std::lcm(hyperperiodMs, static_cast<uint64_t>(svc->getPeriod()));
+        }
+        _hyperperiodNs = hyperperiodMs * 1'000'000ULL;
+
+        // First release one period after the origin, as the per-service timers did
+        for (auto& svc : _services) {
+            uint64_t periodMs = svc->getPeriod();
+            if (periodMs == 0 || svc->isDataTriggered()) {
+                continue;
+            }
+            for (uint64_t t = periodMs; t <= hyperperiodMs; t += periodMs) {
+                _schedule.push_back({t * 1'000'000ULL, svc.get()});
+            }
+        }
+
+        // Ties at the same instant go out in rate-monotonic order (shortest period first)
+        std::stable_sort(_schedule.begin(), _schedule.end(),
+            [](const ScheduledRelease& a, const ScheduledRelease& b) {
+                if (a.offsetNs != b.offsetNs) {
+                    return a.offsetNs < b.offsetNs;
+                }
+                return a.service->getPeriod() < b.service->getPeriod();
+            });
+    }
+
+    void _dispatch(std::stop_token stopToken)
+    {
+        // The dispatcher must preempt every service it releases
+        sched_param sch_params;
+        sch_params.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sch_params) != 0) {
+            perror("Failed to set dispatcher scheduling policy/priority");
+        }
+
+        uint64_t origin = monotonicNowNs();
+        for (uint64_t cycle = 0; !stopToken.stop_requested(); ++cycle) {
+            uint64_t cycleStart = origin + cycle * _hyperperiodNs;
+
+            for (size_t i = 0; i < _schedule.size() && !stopToken.stop_requested(); ) {
+                uint64_t scheduled = cycleStart + _schedule[i].offsetNs;
+                struct timespec wake = nsToTimespec(scheduled);
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR) {}
+
+                // Release everything due at this instant
+                uint64_t now = monotonicNowNs();
+                for (; i < _schedule.size() && cycleStart + _schedule[i].offsetNs == scheduled; ++i) {
+                    _schedule[i].service->release(scheduled, now);
+                }
+            }
+        }
+    }
 };
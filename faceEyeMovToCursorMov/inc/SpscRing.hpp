@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded single-producer/single-consumer queue. push() and pop() are
+// wait-free and never enter the kernel, so it is safe to use between
+// real-time services. N must be a power of two.
+template<typename T, size_t N>
+class SpscRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    // Returns false (leaving value untouched) when the ring is full
+    bool push(T&& value)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        _slots[head & (N - 1)] = std::move(value);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool push(const T& value)
+    {
+        T copy = value;
+        return push(std::move(copy));
+    }
+
+    // Returns false when the ring is empty
+    bool pop(T& value)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(_slots[tail & (N - 1)]);
+        _slots[tail & (N - 1)] = T();
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T _slots[N] = {};
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+
+inline uint64_t timespecToNs(const struct timespec& ts)
+{
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+inline struct timespec nsToTimespec(uint64_t ns)
+{
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    return ts;
+}
+
+// Current time on CLOCK_MONOTONIC, the clock V4L2 stamps buffers with
+inline uint64_t monotonicNowNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespecToNs(now);
+}
@@ -1,114 +1,345 @@
 #include "Compression.hpp"
+#include "LatencyTrace.hpp"
+#include "FrameBus.hpp"
+#include "PixelKernels.hpp"
+#include "ImageWriter.hpp"
+#include "Histogram.hpp"
+#include "QualityController.hpp"
+#include "TimeUtils.hpp"
+#include "Logging.hpp"
+#include "Metrics.hpp"
+#include <atomic>
+#include <cmath>
 #include <opencv2/opencv.hpp>
-#include <filesystem>
-#include <sstream>
-#include <iomanip>
-#include <ctime>
 #include <vector>
-#include <fstream>
 #include <linux/videodev2.h>
-#include <zmq.hpp>
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
 
-extern zmq::socket_t zmq_sub_socket_compress; // Changed to sub socket
+static int frame_subscriber = -1; // FrameBus subscription for frame input
 static bool folder_initialized = false;
 static constexpr uint8_t IMAGE_QUALITY =80;
-// Metadata info
-struct FrameMetadata {
-    int width;
-    int height;
-    uint32_t format;
-    size_t data_size;
-};
-
-void initCompressionService()
+static CompressionConfig compression_config;
+static cv::Mat image; // BGR input of the OpenCV encoder, reused across frames
+static cv::Mat scaled_image; // image downscaled by the quality controller
+static std::vector<unsigned char> compressed_data; // Encoder output, recycled by the image writer
+static size_t compressed_size = 0;                 // Bytes of compressed_data holding the JPEG
+
+// Motion gate: decimated luma of the current and the last encoded frame,
+// and the SADs of their blocks
+static constexpr int MOTION_DECIMATION = 4;
+static std::vector<uint8_t> motion_luma;
+static std::vector<uint8_t> reference_luma;
+static std::vector<uint32_t> block_sads;
+static unsigned frames_since_encoded = 0;
+static std::atomic<uint64_t> frames_gated{0};
+static std::atomic<uint64_t> frames_skipped{0};
+static std::atomic<uint64_t> keyframes{0};
+
+// Adapts quality and resolution when compression_config.adaptiveQuality is set
+static QualityController quality_controller;
+static std::atomic<uint64_t> settings_changes{0};
+
+// Settings and output of the last encoded frame, for the metrics
+static std::atomic<int> last_quality{IMAGE_QUALITY};
+static std::atomic<int> last_downscale{1};
+static std::atomic<uint64_t> bytes_encoded{0};
+
+// Conversion plus encode time per frame (us), one histogram per encoder
+static Histogram encode_time[2];
+
+#ifdef HAVE_TURBOJPEG
+static tjhandle turbo_handle = nullptr;
+static std::vector<uint8_t> yuv_planes; // Planar input of the turbo encoder
+#endif
+
+const char* compressionEncoderName()
 {
-    std::filesystem::create_directory("images");
-    folder_initialized = true;
+    if (compression_config.encoder == JpegEncoder::OpenCv) {
+        return "OpenCV imencode (BGR)";
+    }
+    return compression_config.chroma420 ? "libjpeg-turbo (YUV 4:2:0)" : "libjpeg-turbo (YUV 4:2:2)";
 }
 
-void imageCompressionService() {
+void initCompressionService(const CompressionConfig& config)
+{
+    compression_config = config;
+    QualityControlConfig quality_config;
+    quality_config.encodeBudgetUs = config.encodeBudgetUs;
+    quality_config.bitrateKbps = config.bitrateKbps;
+    quality_config.maxQuality = IMAGE_QUALITY;
+    quality_controller.configure(quality_config);
+#ifdef HAVE_TURBOJPEG
+    if (compression_config.encoder == JpegEncoder::TurboJpeg) {
+        turbo_handle = tjInitCompress();
+        if (turbo_handle == nullptr) {
+            std::fprintf(stderr, "tjInitCompress failed: %s, using OpenCV\n", tjGetErrorStr2(nullptr));
+            compression_config.encoder = JpegEncoder::OpenCv;
+        }
+    }
+#else
+    if (compression_config.encoder == JpegEncoder::TurboJpeg) {
+        std::fputs("Built without libjpeg-turbo, using OpenCV for JPEG\n", stderr);
+        compression_config.encoder = JpegEncoder::OpenCv;
+    }
+#endif
+
+    // Files are written by the image writer thread, never in this service
+    folder_initialized = imageWriterInit();
+    frame_subscriber = frame_bus.subscribe("imageCompressionService");
+}
 
-    // Compress the image to JPEG
-    std::vector<unsigned char> compressed_data;
-    std::vector<int> compression_params = {cv::IMWRITE_JPEG_QUALITY, IMAGE_QUALITY};
-    // Receive the metadata (first part of the multi-part message)
-    zmq::message_t metadata_msg;
-    FrameMetadata metadata;
-    // Receive the raw frame data (second part)
-    zmq::message_t frame_msg;
+void deinitCompressionService()
+{
+    imageWriterDeinit();
+    logImageWriterStatistics();
 
-    while (true) {
+    if (compression_config.motionGate) {
+        std::printf("Motion gate: %llu of %llu frames skipped as unchanged, %llu forced keyframes\n",
+                    static_cast<unsigned long long>(frames_skipped.load(std::memory_order_relaxed)),
+                    static_cast<unsigned long long>(frames_gated.load(std::memory_order_relaxed)),
+                    static_cast<unsigned long long>(keyframes.load(std::memory_order_relaxed)));
+    }
 
-        if (!zmq_sub_socket_compress.recv(metadata_msg, zmq::recv_flags::dontwait)) {
-            break; // No message available, exit loop
-        }
+    if (compression_config.adaptiveQuality) {
+        EncodeSettings settings = quality_controller.settings();
+        std::printf("Adaptive quality: %llu changes, ended at quality %d, 1/%d scale\n",
+                    static_cast<unsigned long long>(settings_changes.load(std::memory_order_relaxed)), settings.quality, settings.downscale);
+    }
 
-        // Ensure the second part (frame data) is available
-        if (!metadata_msg.more()) {
-            std::fputs("Missing frame data part in ZMQ message\n", stderr);
+    const char* names[2] = {"libjpeg-turbo", "OpenCV"};
+    for (unsigned i = 0; i < 2; ++i) {
+        const Histogram& h = encode_time[i];
+        if (h.count() == 0) {
             continue;
         }
+        std::printf("JPEG encode with %s (%llu frames): mean %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+                    names[i], static_cast<unsigned long long>(h.count()), h.mean() / 1000.0,
+                    h.percentile(50) / 1000.0, h.percentile(99) / 1000.0, h.max() / 1000.0);
+    }
 
+#ifdef HAVE_TURBOJPEG
+    if (turbo_handle != nullptr) {
+        tjDestroy(turbo_handle);
+        turbo_handle = nullptr;
+    }
+#endif
+}
 
-        if (metadata_msg.size() != sizeof(FrameMetadata)) {
-            std::fputs("Invalid metadata size received\n", stderr);
-            continue;
+void collectCompressionMetrics(MetricsWriter& out)
+{
+    const char* labels[2] = {"encoder=\"turbojpeg\"", "encoder=\"opencv\""};
+    for (unsigned i = 0; i < 2; ++i) {
+        if (encode_time[i].count() > 0) {
+            out.summary("femc_jpeg_encode_seconds", "Conversion plus JPEG encode time per frame",
+                        encode_time[i], 1e-6, labels[i]);
         }
+    }
+    out.counter("femc_jpeg_bytes_total", "JPEG bytes produced", bytes_encoded.load(std::memory_order_relaxed));
+    out.gauge("femc_jpeg_quality", "JPEG quality of the last encoded frame", last_quality.load(std::memory_order_relaxed));
+    out.gauge("femc_jpeg_downscale", "Downscale factor of the last encoded frame",
+              last_downscale.load(std::memory_order_relaxed));
+    out.counter("femc_jpeg_settings_changes_total", "Quality/resolution changes made by the encode budget",
+                settings_changes.load(std::memory_order_relaxed));
+    out.counter("femc_motion_gate_frames_total", "Frames checked by the motion gate",
+                frames_gated.load(std::memory_order_relaxed));
+    out.counter("femc_motion_gate_skipped_total", "Frames not encoded because they had not changed",
+                frames_skipped.load(std::memory_order_relaxed));
+    out.counter("femc_motion_gate_keyframes_total", "Unchanged frames encoded anyway by the keyframe interval",
+                keyframes.load(std::memory_order_relaxed));
+    collectImageWriterMetrics(out);
+}
 
-        memcpy(&metadata, metadata_msg.data(), sizeof(FrameMetadata));
+#ifdef HAVE_TURBOJPEG
+// The camera's YUV goes to the encoder as planes, so there is no colour
+// conversion at all: YUYV is only de-interleaved (and for 4:2:0 the chroma
+// rows averaged). Downscaled frames are always 4:2:0.
+static bool encodeTurboJpeg(const uint8_t* yuyv, int width, int height, const EncodeSettings& settings)
+{
+    int src_width = width;
+    width /= settings.downscale;
+    height /= settings.downscale;
+    bool chroma420 = settings.downscale > 1 || (compression_config.chroma420 && height % 2 == 0);
+    int subsampling = chroma420 ? TJSAMP_420 : TJSAMP_422;
+    size_t luma_size = static_cast<size_t>(width) * height;
+    size_t chroma_size = chroma420 ? luma_size / 4 : luma_size / 2;
+    yuv_planes.resize(luma_size + 2 * chroma_size);
+    uint8_t* y = yuv_planes.data();
+    uint8_t* u = y + luma_size;
+    uint8_t* v = u + chroma_size;
+    if (settings.downscale > 1) {
+        yuyvToI420Decimated(yuyv, src_width * 2, y, u, v, src_width, height * settings.downscale, settings.downscale);
+    } else if (chroma420) {
+        yuyvToI420(yuyv, width * 2, y, u, v, width, height);
+    } else {
+        yuyvToI422(yuyv, width * 2, y, u, v, width, height);
+    }
+
+    // NOREALLOC: encode straight into the buffer handed to the image writer,
+    // kept at the worst-case size. Recycled buffers keep their size, so it
+    // only grows (and zero-fills) the first time each one is used.
+    unsigned long needed = tjBufSize(width, height, subsampling);
+    if (compressed_data.size() < needed) {
+        compressed_data.resize(needed);
+    }
+    const unsigned char* planes[3] = {y, u, v};
+    unsigned char* jpeg = compressed_data.data();
+    unsigned long jpeg_size = compressed_data.size();
+    if (tjCompressFromYUVPlanes(turbo_handle, planes, width, nullptr, height, subsampling,
+                                &jpeg, &jpeg_size, settings.quality, TJFLAG_NOREALLOC) != 0) {
+        std::fprintf(stderr, "tjCompressFromYUVPlanes failed: %s\n", tjGetErrorStr2(turbo_handle));
+        return false;
+    }
+    compressed_size = jpeg_size;
+    return true;
+}
+#endif
+
+static bool encodeOpenCv(const uint8_t* yuyv, int width, int height, const EncodeSettings& settings)
+{
+    const std::vector<int> compression_params = {cv::IMWRITE_JPEG_QUALITY, settings.quality};
+
+    // Convert straight from the shared YUYV buffer into a reused BGR image
+    image.create(height, width, CV_8UC3);
+    yuyvToBgr(yuyv, width * 2, image.data, image.step, width, height);
+    bool encoded;
+    if (settings.downscale == 1) {
+        encoded = cv::imencode(".jpg", image, compressed_data, compression_params);
+    } else {
+        cv::resize(image, scaled_image, cv::Size(width / settings.downscale, height / settings.downscale),
+                   0, 0, cv::INTER_AREA);
+        encoded = cv::imencode(".jpg", scaled_image, compressed_data, compression_params);
+    }
+    compressed_size = compressed_data.size();
+    return encoded;
+}
+
+// Settings for a width x height frame: fixed unless the controller is on,
+// and full size when the frame does not divide evenly
+static EncodeSettings encodeSettings(int width, int height)
+{
+    if (!compression_config.adaptiveQuality) {
+        return {IMAGE_QUALITY, 1};
+    }
+    EncodeSettings settings = quality_controller.settings();
+    if (width % (2 * settings.downscale) != 0 || height % (2 * settings.downscale) != 0) {
+        settings.downscale = 1;
+    }
+    return settings;
+}
+
+// One record per frame in the event log, so quality changes can be audited
+static void logEncode(uint64_t frame_id, const EncodeSettings& settings, uint64_t encode_us, size_t bytes)
+{
+    logEvent(LogEvent::FrameEncoded, frame_id, settings.quality, settings.downscale, encode_us, bytes,
+             std::lround(quality_controller.bitrateKbps()));
+}
+
+// True if the frame changed enough since the last encoded one to be worth encoding
+static bool motionGatePasses(const uint8_t* yuyv, int width, int height)
+{
+    int luma_width = width / MOTION_DECIMATION;
+    int luma_height = height / MOTION_DECIMATION;
+    size_t luma_size = static_cast<size_t>(luma_width) * luma_height;
+    motion_luma.resize(luma_size);
+    yuyvToYDecimated(yuyv, width * 2, motion_luma.data(), luma_width, width, height, MOTION_DECIMATION);
+    frames_gated.fetch_add(1, std::memory_order_relaxed);
+
+    bool changed;
+    if (reference_luma.size() != luma_size) {
+        changed = true; // First frame or the resolution changed
+    } else {
+        block_sads.resize(static_cast<size_t>(luma_width / 8) * (luma_height / 8));
+        blockSad8x8(motion_luma.data(), luma_width, reference_luma.data(), luma_width,
+                    luma_width, luma_height, block_sads.data());
+        uint32_t block_threshold = static_cast<uint32_t>(compression_config.motionThreshold) * 64;
+        int changed_blocks = 0;
+        for (uint32_t sad : block_sads) {
+            changed_blocks += sad > block_threshold;
+        }
+        changed = changed_blocks >= compression_config.motionMinBlocks;
+
+        // An unchanged frame is still encoded once the keyframe interval is up
+        if (!changed && compression_config.keyframeInterval > 0
+            && frames_since_encoded + 1 >= compression_config.keyframeInterval) {
+            changed = true;
+            keyframes.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!changed) {
+        frames_since_encoded++;
+        frames_skipped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Compare against what was last encoded, so slow drift still adds up
+    std::swap(motion_luma, reference_luma);
+    frames_since_encoded = 0;
+    return true;
+}
+
+void imageCompressionService() {
+
+    FrameRef shared_frame;
+
+    while (frame_bus.poll(frame_subscriber, shared_frame)) {
+        const FrameMetadata& metadata = shared_frame->metadata;
 
         // Verify format
         if (metadata.format != V4L2_PIX_FMT_YUYV) {
             std::fprintf(stderr, "Unsupported frame format: %u\n", metadata.format);
             continue;
         }
-
-
-        if (!zmq_sub_socket_compress.recv(frame_msg, zmq::recv_flags::dontwait)) {
-            std::fputs("Failed to receive frame data\n", stderr);
+        if (!frameHoldsYuyv(metadata)) {
+            std::fprintf(stderr, "Frame data size mismatch: %zu bytes for %dx%d\n",
+                         metadata.data_size, metadata.width, metadata.height);
             continue;
         }
+        latencyTraceEnter(metadata.frame_id, Stage::Compression);
 
-        if (frame_msg.size() != metadata.data_size) {
-            std::fprintf(stderr, "Frame data size mismatch: expected %zu, received %zu\n",
-                         metadata.data_size, frame_msg.size());
+        const uint8_t* yuyv = static_cast<const uint8_t*>(shared_frame->data);
+        if (compression_config.motionGate && !motionGatePasses(yuyv, metadata.width, metadata.height)) {
+            latencyTraceExit(metadata.frame_id, metadata.capture_ns, Stage::Compression);
             continue;
         }
 
-        // Create a cv::Mat from the raw YUYV data
-        cv::Mat yuyv(metadata.height, metadata.width, CV_8UC2, frame_msg.data());
-        cv::Mat image;
-        try {
-            cv::cvtColor(yuyv, image, cv::COLOR_YUV2BGR_YUYV);
-        } catch (const cv::Exception& e) {
-            std::fprintf(stderr, "Color conversion failed: %s\n", e.what());
-            continue;
+        // Compress the image to JPEG
+        EncodeSettings settings = encodeSettings(metadata.width, metadata.height);
+        uint64_t encode_start = monotonicNowNs();
+        bool encoded;
+        unsigned encoder = static_cast<unsigned>(compression_config.encoder);
+#ifdef HAVE_TURBOJPEG
+        if (compression_config.encoder == JpegEncoder::TurboJpeg) {
+            encoded = encodeTurboJpeg(yuyv, metadata.width, metadata.height, settings);
+        } else
+#endif
+        {
+            encoded = encodeOpenCv(yuyv, metadata.width, metadata.height, settings);
         }
-        if (image.empty()) {
-            std::fputs("Failed to convert frame to BGR\n", stderr);
+        if (!encoded) {
+            std::fputs("Failed to compress image\n", stderr);
             continue;
         }
+        uint64_t encode_us = (monotonicNowNs() - encode_start) / 1000;
+        encode_time[encoder].record(encode_us);
+        last_quality.store(settings.quality, std::memory_order_relaxed);
+        last_downscale.store(settings.downscale, std::memory_order_relaxed);
+        bytes_encoded.fetch_add(compressed_size, std::memory_order_relaxed);
 
-
-        if (!cv::imencode(".jpg", image, compressed_data, compression_params)) {
-            std::fputs("Failed to compress image\n", stderr);
-            continue;
+        if (compression_config.adaptiveQuality) {
+            // Each frame's settings go to the event log, so a change shows up
+            // there (and in the metrics) without printing from this thread
+            logEncode(metadata.frame_id, settings, encode_us, compressed_size);
+            if (quality_controller.update(encode_us, compressed_size, metadata.capture_ns)) {
+                settings_changes.fetch_add(1, std::memory_order_relaxed);
+            }
         }
 
-        // Generate a unique filename based on timestamp
-        struct timespec now;
-        clock_gettime(CLOCK_MONOTONIC, &now);
-        std::stringstream filename;
-        filename << "images/image_" << now.tv_sec << "." << std::setw(9) << std::setfill('0') << now.tv_nsec << ".jpg";
-
-        // Save the compressed image to file
-        std::ofstream outfile(filename.str(), std::ios::binary);
-        if (!outfile.is_open()) {
-            std::string error_message = "Failed to open image file: " + filename.str() + "\n";
-            std::fputs(error_message.c_str(), stderr);
-            continue;
+        // Hand off to the writer thread, which appends it to the recording
+        if (folder_initialized) {
+            imageWriterSubmit(compressed_data, compressed_size, metadata.frame_id, metadata.capture_ns);
         }
-        outfile.write(reinterpret_cast<const char*>(compressed_data.data()), compressed_data.size());
-        outfile.close();
+        latencyTraceExit(metadata.frame_id, metadata.capture_ns, Stage::Compression);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,152 @@
+#include "CpuTopology.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+static const char* const SYSFS_CPU = "/sys/devices/system/cpu/";
+
+bool CpuSet::parse(const std::string& list, CpuSet& set)
+{
+    CpuSet parsed;
+    const char* p = list.c_str();
+    while (*p != '\0' && *p != '\n') {
+        char* end;
+        unsigned long low = std::strtoul(p, &end, 10);
+        if (end == p) {
+            return false;
+        }
+        unsigned long high = low;
+        p = end;
+        if (*p == '-') {
+            high = std::strtoul(p + 1, &end, 10);
+            if (end == p + 1 || high < low) {
+                return false;
+            }
+            p = end;
+        }
+        for (unsigned long cpu = low; cpu <= high && cpu < CPU_SETSIZE; ++cpu) {
+            parsed.add(static_cast<unsigned>(cpu));
+        }
+        if (*p == ',') {
+            ++p;
+        } else if (*p != '\0' && *p != '\n') {
+            return false;
+        }
+    }
+    set = parsed;
+    return true;
+}
+
+unsigned CpuSet::first() const
+{
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &_set)) {
+            return cpu;
+        }
+    }
+    return CPU_SETSIZE;
+}
+
+CpuSet CpuSet::operator&(const CpuSet& other) const
+{
+    CpuSet result;
+    CPU_AND(&result._set, &_set, &other._set);
+    return result;
+}
+
+CpuSet CpuSet::operator|(const CpuSet& other) const
+{
+    CpuSet result;
+    CPU_OR(&result._set, &_set, &other._set);
+    return result;
+}
+
+CpuSet CpuSet::operator-(const CpuSet& other) const
+{
+    CpuSet result = *this;
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (other.contains(cpu)) {
+            result.remove(cpu);
+        }
+    }
+    return result;
+}
+
+std::string CpuSet::toString() const
+{
+    std::string list;
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!contains(cpu)) {
+            continue;
+        }
+        unsigned last = cpu;
+        while (last + 1 < CPU_SETSIZE && contains(last + 1)) {
+            ++last;
+        }
+        if (!list.empty()) {
+            list += ',';
+        }
+        list += std::to_string(cpu);
+        if (last > cpu) {
+            list += '-';
+            list += std::to_string(last);
+        }
+        cpu = last;
+    }
+    return list.empty() ? "none" : list;
+}
+
+// A CPU list file from sysfs; a missing file (e.g. nohz_full on a kernel
+// without it) is an empty set
+static CpuSet readCpuList(const std::string& path)
+{
+    CpuSet set;
+    std::ifstream file(path);
+    std::string line;
+    if (file && std::getline(file, line) && !CpuSet::parse(line, set)) {
+        std::fprintf(stderr, "Cannot parse CPU list in %s: %s\n", path.c_str(), line.c_str());
+    }
+    return set;
+}
+
+bool readCpuTopology(CpuTopology& topology)
+{
+    topology.online = readCpuList(std::string(SYSFS_CPU) + "online");
+    if (topology.online.empty()) {
+        // No sysfs (e.g. a minimal container): assume CPUs 0..n-1
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < cpus; ++cpu) {
+            topology.online.add(static_cast<unsigned>(cpu));
+        }
+    }
+
+    CpuSet allowed;
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &mask)) {
+                allowed.add(cpu);
+            }
+        }
+    } else {
+        perror("sched_getaffinity failed");
+        allowed = topology.online;
+    }
+    topology.allowed = allowed & topology.online;
+    topology.isolated = readCpuList(std::string(SYSFS_CPU) + "isolated") & topology.online;
+    topology.nohzFull = readCpuList(std::string(SYSFS_CPU) + "nohz_full") & topology.online;
+
+    topology.primary = CpuSet();
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!topology.online.contains(cpu)) {
+            continue;
+        }
+        CpuSet siblings = readCpuList(std::string(SYSFS_CPU) + "cpu" + std::to_string(cpu)
+                                      + "/topology/thread_siblings_list");
+        if (siblings.empty() || siblings.first() == cpu) {
+            topology.primary.add(cpu);
+        }
+    }
+    return !topology.allowed.empty();
+}
@@ -0,0 +1,129 @@
+#include "CursorFilter.hpp"
+#include <algorithm>
+#include <cmath>
+
+static constexpr double MIN_SAMPLE_INTERVAL_S = 0.001; // Floor for repeated timestamps
+
+// Smoothing factor of a first-order low-pass with the given cutoff
+static double lowPassAlpha(double cutoffHz, double dt)
+{
+    double tau = 1.0 / (2.0 * M_PI * cutoffHz);
+    return 1.0 / (1.0 + tau / dt);
+}
+
+void CursorFilter::configure(const CursorFilterConfig& config)
+{
+    _config = config;
+    reset();
+}
+
+void CursorFilter::reset()
+{
+    _initialized = false;
+    _windowCount = 0;
+    _windowNext = 0;
+    _sumX = 0.0;
+    _sumY = 0.0;
+}
+
+void CursorFilter::_start(double x, double y)
+{
+    reset();
+    double measured[2] = {x, y};
+    for (int i = 0; i < 2; ++i) {
+        _euro[i] = {measured[i], 0.0};
+        // Position known to within the measurement noise, velocity unknown
+        _kalman[i] = {measured[i], 0.0, _config.measurementNoise, 0.0, _config.processNoise};
+    }
+    _initialized = true;
+}
+
+void CursorFilter::update(double x, double y, uint64_t timestampNs)
+{
+    bool restart = !_initialized || timestampNs < _lastNs || timestampNs - _lastNs > RESET_GAP_NS;
+    double dt = restart ? 0.0 : std::max((timestampNs - _lastNs) / 1e9, MIN_SAMPLE_INTERVAL_S);
+    _lastNs = timestampNs;
+
+    if (restart) {
+        _start(x, y);
+    } else if (_config.type == CursorFilterType::OneEuro) {
+        _updateOneEuro(_euro[0], x, dt);
+        _updateOneEuro(_euro[1], y, dt);
+    } else if (_config.type == CursorFilterType::Kalman) {
+        _updateKalman(_kalman[0], x, dt);
+        _updateKalman(_kalman[1], y, dt);
+    }
+
+    if (_config.type == CursorFilterType::MovingAverage) {
+        if (_windowCount == MOVING_AVERAGE_WINDOW) {
+            _sumX -= _windowX[_windowNext];
+            _sumY -= _windowY[_windowNext];
+        } else {
+            _windowCount++;
+        }
+        _windowX[_windowNext] = x;
+        _windowY[_windowNext] = y;
+        _sumX += x;
+        _sumY += y;
+        _windowNext = (_windowNext + 1) % MOVING_AVERAGE_WINDOW;
+    }
+}
+
+void CursorFilter::_updateOneEuro(OneEuroAxis& axis, double measured, double dt)
+{
+    // Filter the speed first, then let it open up the position cutoff
+    double rawDerivative = (measured - axis.value) / dt;
+    double derivativeAlpha = lowPassAlpha(_config.derivativeCutoffHz, dt);
+    axis.derivative += derivativeAlpha * (rawDerivative - axis.derivative);
+
+    double cutoff = _config.minCutoffHz + _config.beta * std::fabs(axis.derivative);
+    axis.value += lowPassAlpha(cutoff, dt) * (measured - axis.value);
+}
+
+void CursorFilter::_updateKalman(KalmanAxis& axis, double measured, double dt)
+{
+    // Predict: x' = F x, P' = F P F^T + Q with F = [1 dt; 0 1]
+    double q = _config.processNoise;
+    axis.position += axis.velocity * dt;
+    double p00 = axis.p00 + 2.0 * dt * axis.p01 + dt * dt * axis.p11 + q * dt * dt * dt / 3.0;
+    double p01 = axis.p01 + dt * axis.p11 + q * dt * dt / 2.0;
+    double p11 = axis.p11 + q * dt;
+
+    // Update with a position measurement, H = [1 0]
+    double innovation = measured - axis.position;
+    double s = p00 + _config.measurementNoise;
+    double k0 = p00 / s;
+    double k1 = p01 / s;
+    axis.position += k0 * innovation;
+    axis.velocity += k1 * innovation;
+    axis.p00 = (1.0 - k0) * p00;
+    axis.p01 = (1.0 - k0) * p01;
+    axis.p11 = p11 - k1 * p01;
+}
+
+bool CursorFilter::position(uint64_t nowNs, double& x, double& y) const
+{
+    if (!_initialized) {
+        return false;
+    }
+
+    switch (_config.type) {
+    case CursorFilterType::MovingAverage:
+        x = _sumX / _windowCount;
+        y = _sumY / _windowCount;
+        break;
+    case CursorFilterType::OneEuro:
+        x = _euro[0].value;
+        y = _euro[1].value;
+        break;
+    case CursorFilterType::Kalman: {
+        // Hide the capture-to-now delay by projecting along the estimated velocity
+        double ahead = nowNs > _lastNs ? (nowNs - _lastNs) / 1e9 : 0.0;
+        ahead = std::min(ahead, _config.maxPredictionMs / 1000.0);
+        x = _kalman[0].position + _kalman[0].velocity * ahead;
+        y = _kalman[1].position + _kalman[1].velocity * ahead;
+        break;
+    }
+    }
+    return true;
+}
@@ -1,4 +1,8 @@
 #include "Logging.hpp"
+#include "LatencyTrace.hpp"
+#include "TimeUtils.hpp"
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <iomanip>
 #include <ctime>
@@ -8,9 +12,16 @@
 #include <vector>
 #include <opencv2/core.hpp>
 #include "MessageQueue.hpp"
+#include "CursorFilter.hpp"
+#include "CursorTranslation.hpp"
+#include "PiMutex.hpp"
+#include "Metrics.hpp"
+#include <atomic>
 #include <fstream>
+#include <mutex>
 #include <string>
 #include <fcntl.h>
+#include <sys/uio.h>
 
 static int message_counter = 0;
 static int fd = 0;
@@ -22,7 +33,47 @@ static constexpr int FACE_X_MIN=120 ;// Min x-coordinate for 60 deg left (after
 static constexpr int FACE_X_MAX=520; // Max x-coordinate for 60 deg right (after inversion)
 static constexpr int FACE_Y_MIN=80 ; // Min y-coordinate for 60 deg up
 static constexpr int FACE_Y_MAX=400 ;// Max y-coordinate for 60 deg down
-static constexpr int SMOOTHING_WINDOW=5 ;// Number of frames for moving average
+
+// Smooths detected centers (in camera pixels) before they are mapped to the display
+static CursorFilter cursor_filter;
+
+// Bounds on how long the output glides from one filtered target to the next
+static constexpr uint64_t MIN_GLIDE_NS = 10'000'000ULL;
+static constexpr uint64_t MAX_GLIDE_NS = 100'000'000ULL;
+
+// With continuous output the translation service only publishes where the
+// cursor should go and cursorOutputService moves it at its own rate
+static bool continuous_output = false;
+
+// Where the cursor is heading, in camera pixels. The output glides from
+// `from` (where it was when the sample arrived) to `to` over one sample
+// interval; a Kalman filter is sampled directly since it extrapolates itself.
+// The frame it came from leaves Stage::CursorOutput when the output first
+// moves the cursor towards it.
+struct CursorTarget {
+    CursorFilter filter;
+    double fromX = 0.0, fromY = 0.0;
+    double toX = 0.0, toY = 0.0;
+    uint64_t startNs = 0;
+    uint64_t glideNs = MIN_GLIDE_NS;
+    uint64_t frameId = 0;
+    uint64_t captureNs = 0;
+    bool valid = false;
+};
+static CursorTarget cursor_target;
+static PiMutex cursor_target_mutex;
+static uint64_t last_sample_ns = 0;
+static uint64_t last_output_frame_id = UINT64_MAX; // Only touched by cursorOutputService
+
+// Last position written to uinput, so unchanged positions are not re-sent
+static int last_display_x = -1;
+static int last_display_y = -1;
+
+// Output counters for the metrics socket
+static std::atomic<uint64_t> cursor_writes{0};
+static std::atomic<uint64_t> cursor_unchanged{0};
+static std::atomic<uint64_t> cursor_write_failures{0};
+static std::atomic<uint64_t> cursor_output_contended{0}; // Output ticks that found the target being updated
 
 // Structure to hold calibration data
 struct CalibrationData {
@@ -35,11 +86,6 @@ struct CalibrationData {
 // Global calibration data (defaults match original constants)
 static CalibrationData calib_data = {0, 0, 0, 0};
 
-// Callback to free the string memory
-void free_string(void* data, void* hint) {
-    delete[] static_cast<char*>(hint);
-}
-
 // Load calibration data from file
 void loadCalibrationData(const std::string& filename) {
     std::ifstream file(filename);
@@ -66,7 +112,10 @@ void loadCalibrationData(const std::string& filename) {
     }
 }
 
-uint8_t cursorInit(uint8_t detectiontype) {
+uint8_t cursorInit(uint8_t detectiontype, const CursorFilterConfig& filter, bool continuousOutput) {
+    cursor_filter.configure(filter);
+    continuous_output = continuousOutput;
+
     // Load calibration data
     if(detectiontype == 1)
     {
@@ -122,80 +171,170 @@ void cursorDeinit() {
     close(fd);
 }
 
+// Position along the target at nowNs, in camera pixels
+static bool targetPosition(const CursorTarget& target, uint64_t nowNs, double& x, double& y)
+{
+    if (!target.valid) {
+        return false;
+    }
+    if (target.filter.type() == CursorFilterType::Kalman) {
+        return target.filter.position(nowNs, x, y);
+    }
+    double t = nowNs > target.startNs ? static_cast<double>(nowNs - target.startNs) / target.glideNs : 0.0;
+    t = std::min(t, 1.0);
+    x = target.fromX + (target.toX - target.fromX) * t;
+    y = target.fromY + (target.toY - target.fromY) * t;
+    return true;
+}
+
+// Map a position in (mirrored) camera pixels to the display
+static void toDisplay(double camera_x, double camera_y, int& display_x, int& display_y)
+{
+    int x = static_cast<int>(std::lround(camera_x));
+    int y = static_cast<int>(std::lround(camera_y));
+
+    // Normalize coordinates to [0, 1] based on calibration data
+    float norm_x = static_cast<float>(x - calib_data.right_x) / (calib_data.left_x - calib_data.right_x);
+    float norm_y = static_cast<float>(y - calib_data.top_y) / (calib_data.bottom_y - calib_data.top_y);
+
+    // Map normalized coordinates to display coordinates
+    display_x = static_cast<int>(norm_x * DISPLAY_X);
+    display_y = static_cast<int>(norm_y * DISPLAY_Y);
+
+    // Ensure coordinates are within display bounds
+    display_x = std::max(0, std::min(display_x, DISPLAY_X));
+    display_y = std::max(0, std::min(display_y, DISPLAY_Y));
+}
+
+// Move the cursor using uinput: ABS_X, ABS_Y and SYN_REPORT in one syscall,
+// skipped entirely when the position has not changed. Returns false if the
+// write failed, i.e. the cursor is not where it was asked to be.
+static bool moveCursor(int display_x, int display_y)
+{
+    if (display_x == last_display_x && display_y == last_display_y) {
+        cursor_unchanged.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    struct input_event ev[3];
+    memset(ev, 0, sizeof(ev));
+    gettimeofday(&ev[0].time, nullptr);
+    ev[1].time = ev[0].time;
+    ev[2].time = ev[0].time;
+
+    ev[0].type = EV_ABS;
+    ev[0].code = ABS_X;
+    ev[0].value = display_x;
+    ev[1].type = EV_ABS;
+    ev[1].code = ABS_Y;
+    ev[1].value = display_y;
+    ev[2].type = EV_SYN;
+    ev[2].code = SYN_REPORT;
+
+    struct iovec iov = {ev, sizeof(ev)};
+    if (writev(fd, &iov, 1) == static_cast<ssize_t>(sizeof(ev))) {
+        last_display_x = display_x;
+        last_display_y = display_y;
+        cursor_writes.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    cursor_write_failures.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
 void cursorTranslationService() {
-    // Smoothing buffer
-    static std::vector<cv::Point> recent_centers;
-
-    // Receive face center coordinates
-    zmq::message_t face_msg;
-    if (zmq_pull_face_socket.recv(face_msg, zmq::recv_flags::dontwait)) {
-        std::string received_str(static_cast<char*>(face_msg.data()), face_msg.size());
-
-        // Parse the face center coordinates
-        int x, y;
-        if (sscanf(received_str.c_str(), "Center:%d,%d", &x, &y) == 2) {
-            // Invert x-coordinate to correct for mirrored camera image
-            x = CAMERA_X - x;
-
-            // Smooth coordinates using moving average
-            recent_centers.push_back(cv::Point(x, y));
-            if (recent_centers.size() > SMOOTHING_WINDOW) {
-                recent_centers.erase(recent_centers.begin());
-            }
-            float avg_x = 0, avg_y = 0;
-            for (const auto& p : recent_centers) {
-                avg_x += p.x;
-                avg_y += p.y;
-            }
-            avg_x /= recent_centers.size();
-            avg_y /= recent_centers.size();
-            x = static_cast<int>(avg_x);
-            y = static_cast<int>(avg_y);
-
-            // Normalize coordinates to [0, 1] based on calibration data
-            float norm_x = static_cast<float>(x - calib_data.right_x) / (calib_data.left_x - calib_data.right_x);
-            float norm_y = static_cast<float>(y - calib_data.top_y) / (calib_data.bottom_y - calib_data.top_y);
-
-            // Map normalized coordinates to display coordinates
-            int display_x = static_cast<int>(norm_x * DISPLAY_X);
-            int display_y = static_cast<int>(norm_y * DISPLAY_Y);
-
-            // Ensure coordinates are within display bounds
-            display_x = std::max(0, std::min(display_x, DISPLAY_X));
-            display_y = std::max(0, std::min(display_y, DISPLAY_Y));
-
-            // Move cursor using uinput
-            struct input_event ev;
-            memset(&ev, 0, sizeof(ev));
-            gettimeofday(&ev.time, nullptr);
-
-            ev.type = EV_ABS;
-            ev.code = ABS_X;
-            ev.value = display_x;
-            write(fd, &ev, sizeof(ev));
-
-            ev.code = ABS_Y;
-            ev.value = display_y;
-            write(fd, &ev, sizeof(ev));
-
-            // Synchronize
-            ev.type = EV_SYN;
-            ev.code = SYN_REPORT;
-            ev.value = 0;
-            write(fd, &ev, sizeof(ev));
-
-            // Create the string message dynamically
-            char buffer[100];
-            snprintf(buffer, sizeof(buffer), "Center: %d x %d ,Cursor: %d x %d", x, y, display_x, display_y);
-            size_t len = strlen(buffer) + 1; // Include null terminator
-            char* msg_str = new char[len];
-            strncpy(msg_str, buffer, len);
-
-            // Send a pointer to the string to the message queue
-            zmq::message_t msg(msg_str, len, free_string, msg_str);
-            zmq_push_control_socket.send(msg, zmq::send_flags::dontwait);
+    // Receive face center coordinates; drain everything queued so a
+    // coalesced release does not leave centers behind
+    CenterMessage center;
+    while (face_center_queue.pop(center)) {
+        latencyTraceEnter(center.frame_id, Stage::CursorTranslation);
+        int x = center.x;
+        int y = center.y;
+
+        // Invert x-coordinate to correct for mirrored camera image
+        x = CAMERA_X - x;
+
+        // Smooth coordinates, stamped with the capture time of their frame
+        cursor_filter.update(x, y, center.capture_ns);
+        uint64_t now = monotonicNowNs();
+        double filtered_x, filtered_y;
+        cursor_filter.position(now, filtered_x, filtered_y);
+        int display_x, display_y;
+        toDisplay(filtered_x, filtered_y, display_x, display_y);
+        x = static_cast<int>(std::lround(filtered_x));
+        y = static_cast<int>(std::lround(filtered_y));
+
+        // The target is known: every center leaves translation here, and the
+        // wait until the cursor moves (the next output tick with continuous
+        // output) is traced separately. Entered before the target is
+        // published so the output service cannot exit it first.
+        latencyTraceExit(center.frame_id, center.capture_ns, Stage::CursorTranslation);
+        latencyTraceEnter(center.frame_id, Stage::CursorOutput);
+
+        if (continuous_output) {
+            // Glide over the spacing between samples so the cursor arrives
+            // about when the next target does
+            uint64_t interval = center.capture_ns > last_sample_ns ? center.capture_ns - last_sample_ns : 0;
+            last_sample_ns = center.capture_ns;
+
+            std::lock_guard<PiMutex> lock(cursor_target_mutex);
+            double from_x = filtered_x, from_y = filtered_y;
+            targetPosition(cursor_target, now, from_x, from_y);
+            cursor_target.filter = cursor_filter;
+            cursor_target.fromX = from_x;
+            cursor_target.fromY = from_y;
+            cursor_target.toX = filtered_x;
+            cursor_target.toY = filtered_y;
+            cursor_target.startNs = now;
+            cursor_target.glideNs = std::clamp(interval, MIN_GLIDE_NS, MAX_GLIDE_NS);
+            cursor_target.frameId = center.frame_id;
+            cursor_target.captureNs = center.capture_ns;
+            cursor_target.valid = true;
         } else {
-            std::cerr << "Failed to parse face center data: " << received_str << std::endl;
+            if (moveCursor(display_x, display_y)) {
+                latencyTraceExit(center.frame_id, center.capture_ns, Stage::CursorOutput);
+            }
         }
+        int64_t latency_us = static_cast<int64_t>(monotonicNowNs() - center.capture_ns) / 1000;
+        logEvent(LogEvent::CursorMove, center.frame_id, x, y, display_x, display_y, latency_us);
     }
 }
+
+void cursorOutputService() {
+    // Never wait on the translation service: if it is publishing a new
+    // target right now, the next tick picks it up
+    CursorTarget target;
+    {
+        std::unique_lock<PiMutex> lock(cursor_target_mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            cursor_output_contended.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        target = cursor_target;
+    }
+
+    double x, y;
+    if (!targetPosition(target, monotonicNowNs(), x, y)) {
+        return;
+    }
+    int display_x, display_y;
+    toDisplay(x, y, display_x, display_y);
+    if (moveCursor(display_x, display_y) && target.frameId != last_output_frame_id) {
+        // The cursor has started towards this frame's target: the frame has
+        // reached the screen
+        last_output_frame_id = target.frameId;
+        latencyTraceExit(target.frameId, target.captureNs, Stage::CursorOutput);
+    }
+}
+
+void collectCursorMetrics(MetricsWriter& out)
+{
+    out.counter("femc_cursor_writes_total", "Cursor positions written to uinput",
+                cursor_writes.load(std::memory_order_relaxed));
+    out.counter("femc_cursor_unchanged_total", "Cursor updates skipped because the position had not changed",
+                cursor_unchanged.load(std::memory_order_relaxed));
+    out.counter("femc_cursor_write_failures_total", "Failed uinput writes",
+                cursor_write_failures.load(std::memory_order_relaxed));
+    out.counter("femc_cursor_output_contended_total", "Output ticks skipped while the target was being updated",
+                cursor_output_contended.load(std::memory_order_relaxed));
+}
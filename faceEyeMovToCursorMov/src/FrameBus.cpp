@@ -0,0 +1,93 @@
+#include "FrameBus.hpp"
+#include "Metrics.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+FrameBus frame_bus;
+
+int FrameBus::subscribe(const char* name)
+{
+    if (_subscriberCount == MAX_SUBSCRIBERS) {
+        std::fprintf(stderr, "FrameBus: no subscriber slot left for %s\n", name);
+        return -1;
+    }
+    _subscribers[_subscriberCount].name = name;
+    return _subscriberCount++;
+}
+
+bool FrameBus::setListener(const char* name, std::function<void()> listener)
+{
+    for (int i = 0; i < _subscriberCount; ++i) {
+        if (std::strcmp(_subscribers[i].name, name) == 0) {
+            _subscribers[i].listener = std::move(listener);
+            return true;
+        }
+    }
+    std::fprintf(stderr, "FrameBus: no subscriber named %s\n", name);
+    return false;
+}
+
+void FrameBus::publish(const FrameRef& frame)
+{
+    _published.fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < _subscriberCount; ++i) {
+        Subscriber& subscriber = _subscribers[i];
+        if (subscriber.queue.push(frame)) {
+            subscriber.delivered.fetch_add(1, std::memory_order_relaxed);
+            if (subscriber.listener) {
+                subscriber.listener();
+            }
+        } else {
+            subscriber.dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool FrameBus::poll(int subscriber, FrameRef& frame)
+{
+    if (subscriber < 0 || subscriber >= _subscriberCount) {
+        return false;
+    }
+    return _subscribers[subscriber].queue.pop(frame);
+}
+
+void FrameBus::clear()
+{
+    FrameRef frame;
+    for (int i = 0; i < _subscriberCount; ++i) {
+        while (_subscribers[i].queue.pop(frame)) {
+            frame.reset();
+        }
+    }
+}
+
+void FrameBus::logStatistics() const
+{
+    std::printf("Frame bus: %llu frames published\n",
+                static_cast<unsigned long long>(_published.load(std::memory_order_relaxed)));
+    for (int i = 0; i < _subscriberCount; ++i) {
+        const Subscriber& subscriber = _subscribers[i];
+        std::printf("  %s: %llu delivered, %llu dropped\n", subscriber.name,
+                    static_cast<unsigned long long>(subscriber.delivered.load(std::memory_order_relaxed)),
+                    static_cast<unsigned long long>(subscriber.dropped.load(std::memory_order_relaxed)));
+    }
+}
+
+void FrameBus::collectMetrics(MetricsWriter& out) const
+{
+    out.counter("femc_frame_bus_published_total", "Frames published on the frame bus",
+                _published.load(std::memory_order_relaxed));
+    std::string labels[MAX_SUBSCRIBERS];
+    for (int i = 0; i < _subscriberCount; ++i) {
+        labels[i] = std::string("subscriber=\"") + _subscribers[i].name + "\"";
+    }
+    for (int i = 0; i < _subscriberCount; ++i) {
+        out.counter("femc_frame_bus_delivered_total", "Frames queued for a subscriber",
+                    _subscribers[i].delivered.load(std::memory_order_relaxed), labels[i].c_str());
+    }
+    for (int i = 0; i < _subscriberCount; ++i) {
+        out.counter("femc_frame_bus_dropped_total", "Frames a subscriber missed because its queue was full",
+                    _subscribers[i].dropped.load(std::memory_order_relaxed), labels[i].c_str());
+    }
+}
@@ -0,0 +1,99 @@
+#include "FramePool.hpp"
+#include <cstdio>
+
+FrameRef::FrameRef(const FrameRef& other) : _slot(other._slot)
+{
+    if (_slot) {
+        _slot->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameRef& FrameRef::operator=(const FrameRef& other)
+{
+    if (this != &other) {
+        FrameRef copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+FrameRef& FrameRef::operator=(FrameRef&& other) noexcept
+{
+    if (this != &other) {
+        reset();
+        _slot = other._slot;
+        other._slot = nullptr;
+    }
+    return *this;
+}
+
+void FrameRef::reset()
+{
+    if (_slot == nullptr) {
+        return;
+    }
+    // The last reference out hands the buffer back; acq_rel orders every
+    // consumer's reads of the pixels before the driver may overwrite them
+    if (_slot->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        _slot->pool->_recycle(_slot);
+    }
+    _slot = nullptr;
+}
+
+void FramePool::init(FrameSource* source)
+{
+    _source = source;
+    _size = source->bufferCount();
+    _slots.reset(new FrameRef::Slot[_size]);
+    for (unsigned int i = 0; i < _size; ++i) {
+        _slots[i].index = i;
+        _slots[i].pool = this;
+    }
+}
+
+FrameRef FramePool::wrap(const CapturedFrame& captured, const FrameMetadata& metadata)
+{
+    FrameRef::Slot& slot = _slots[captured.index];
+    if (slot.refs.load(std::memory_order_acquire) != 0) {
+        // The source handed out a buffer consumers still hold; never expose it twice
+        std::fprintf(stderr, "FramePool: buffer %u acquired while still referenced\n", captured.index);
+        return FrameRef();
+    }
+
+    if (_captured > 0 && captured.sequence > _lastSequence + 1) {
+        _sourceDropped += captured.sequence - _lastSequence - 1;
+    }
+    _lastSequence = captured.sequence;
+    _captured++;
+
+    slot.frame.metadata = metadata;
+    slot.frame.data = captured.data;
+    slot.refs.store(1, std::memory_order_release);
+
+    unsigned int outstanding = _outstanding.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (outstanding > _maxOutstanding) {
+        _maxOutstanding = outstanding;
+    }
+    return FrameRef(&slot);
+}
+
+void FramePool::noteNoFrame()
+{
+    if (_size > 0 && outstanding() == _size) {
+        _exhausted++;
+    }
+}
+
+void FramePool::_recycle(FrameRef::Slot* slot)
+{
+    _outstanding.fetch_sub(1, std::memory_order_relaxed);
+    _source->release(slot->index);
+}
+
+void FramePool::logStatistics() const
+{
+    std::printf("Frame pool: %u buffers, %llu frames captured, max %u held by consumers\n",
+                _size, static_cast<unsigned long long>(_captured), _maxOutstanding);
+    std::printf("  Pool exhausted: %llu capture cycles, frames lost by source: %llu\n",
+                static_cast<unsigned long long>(_exhausted), static_cast<unsigned long long>(_sourceDropped));
+}
@@ -0,0 +1,424 @@
+#include "FrameSource.hpp"
+#include "TimeUtils.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <cstdio>
+#include <errno.h>
+
+// Largest frame a recording may claim; anything beyond is taken as corruption
+static constexpr uint32_t MAX_REPLAY_WIDTH = 4096;
+static constexpr uint32_t MAX_REPLAY_HEIGHT = 4096;
+
+/*
+ * V4L2FrameSource
+ */
+
+bool V4L2FrameSource::open()
+{
+    // Open the video device
+    _fd = ::open(_device.c_str(), O_RDWR | O_NONBLOCK);
+    if (_fd == -1) {
+        std::fprintf(stderr, "Failed to open video device %s: %s\n", _device.c_str(), strerror(errno));
+        return false;
+    }
+
+    // Query the camera's capabilities
+    struct v4l2_capability cap;
+    if (ioctl(_fd, VIDIOC_QUERYCAP, &cap) == -1) {
+        std::fprintf(stderr, "VIDIOC_QUERYCAP failed on %s\n", _device.c_str());
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING)) {
+        std::fprintf(stderr, "%s does not support streaming video capture\n", _device.c_str());
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    // Set the format
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = 640;
+    fmt.fmt.pix.height = 480;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    fmt.fmt.pix.field = V4L2_FIELD_ANY;
+    if (ioctl(_fd, VIDIOC_S_FMT, &fmt) == -1) {
+        std::fputs("VIDIOC_S_FMT failed\n", stderr);
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    // Verify the format and dimensions
+    if (fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV) {
+        std::fputs("Camera does not support YUYV\n", stderr);
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    _width = fmt.fmt.pix.width;
+    _height = fmt.fmt.pix.height;
+
+    // Request buffers
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = _requestedBuffers;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(_fd, VIDIOC_REQBUFS, &req) == -1 || req.count < 2) {
+        std::fputs("VIDIOC_REQBUFS failed\n", stderr);
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    if (req.count != _requestedBuffers) {
+        std::fprintf(stderr, "Driver granted %u capture buffers (requested %u)\n", req.count, _requestedBuffers);
+    }
+    _numBuffers = req.count;
+    _buffers.assign(_numBuffers, v4l2_buffer{});
+    _bufferQueued.reset(new std::atomic<bool>[_numBuffers]());
+    _bufferStarts.assign(_numBuffers, nullptr);
+    _bufferLengths.assign(_numBuffers, 0);
+
+    // Map and queue all buffers
+    for (unsigned int i = 0; i < _numBuffers; ++i) {
+        memset(&_buffers[i], 0, sizeof(_buffers[i]));
+        _buffers[i].type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        _buffers[i].memory = V4L2_MEMORY_MMAP;
+        _buffers[i].index = i;
+
+        if (ioctl(_fd, VIDIOC_QUERYBUF, &_buffers[i]) == -1) {
+            std::fputs("VIDIOC_QUERYBUF failed\n", stderr);
+            _unmapBuffers(i);
+            ::close(_fd);
+            _fd = -1;
+            return false;
+        }
+
+        _bufferLengths[i] = _buffers[i].length;
+        _bufferStarts[i] = mmap(NULL, _buffers[i].length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, _buffers[i].m.offset);
+        if (_bufferStarts[i] == MAP_FAILED) {
+            std::fputs("Failed to mmap capture buffer\n", stderr);
+            _bufferStarts[i] = nullptr;
+            _unmapBuffers(i);
+            ::close(_fd);
+            _fd = -1;
+            return false;
+        }
+
+        // Queue the buffer
+        if (ioctl(_fd, VIDIOC_QBUF, &_buffers[i]) == -1) {
+            std::fputs("VIDIOC_QBUF failed\n", stderr);
+            _unmapBuffers(i + 1);
+            ::close(_fd);
+            _fd = -1;
+            return false;
+        }
+        _bufferQueued[i].store(true, std::memory_order_relaxed); // Initially queued
+    }
+
+    // Start streaming
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(_fd, VIDIOC_STREAMON, &type) == -1) {
+        std::fputs("VIDIOC_STREAMON failed\n", stderr);
+        _unmapBuffers(_numBuffers);
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void V4L2FrameSource::close()
+{
+    if (_fd == -1) {
+        return;
+    }
+
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ioctl(_fd, VIDIOC_STREAMOFF, &type);
+    _unmapBuffers(_numBuffers);
+    ::close(_fd);
+    _fd = -1;
+}
+
+void V4L2FrameSource::_unmapBuffers(unsigned int count)
+{
+    for (unsigned int i = 0; i < count; ++i) {
+        if (_bufferStarts[i] != nullptr) {
+            munmap(_bufferStarts[i], _bufferLengths[i]);
+            _bufferStarts[i] = nullptr;
+        }
+    }
+}
+
+bool V4L2FrameSource::_queueBuffer(unsigned int index)
+{
+    // Guard against handing the same buffer to the driver twice
+    if (_bufferQueued[index].exchange(true, std::memory_order_acq_rel)) {
+        return false;
+    }
+
+    // Re-queue the buffer using the original configuration
+    struct v4l2_buffer requeue_buf = _buffers[index];
+    requeue_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    requeue_buf.memory = V4L2_MEMORY_MMAP;
+    requeue_buf.index = index;
+
+    if (ioctl(_fd, VIDIOC_QBUF, &requeue_buf) == -1) {
+        std::fprintf(stderr, "VIDIOC_QBUF failed for buffer %u: %s\n", index, strerror(errno));
+        _bufferQueued[index].store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+bool V4L2FrameSource::acquire(CapturedFrame& frame)
+{
+    // Non-blocking frame capture
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+
+    // Try to dequeue a buffer
+    if (ioctl(_fd, VIDIOC_DQBUF, &buf) == -1) {
+        return false; // EAGAIN: no frame ready yet
+    }
+
+    unsigned int buf_index = buf.index;
+    if (buf_index >= _numBuffers) {
+        // Re-queue to avoid hanging
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = buf_index;
+        ioctl(_fd, VIDIOC_QBUF, &buf);
+        return false;
+    }
+
+    // Update the buffer array and mark as dequeued
+    _buffers[buf_index] = buf;
+    _bufferQueued[buf_index].store(false, std::memory_order_release);
+
+    frame.index = buf_index;
+    frame.data = _bufferStarts[buf_index];
+    frame.size = buf.bytesused;
+    frame.width = _width;
+    frame.height = _height;
+    frame.format = V4L2_PIX_FMT_YUYV;
+    frame.sequence = buf.sequence;
+    frame.timestamp.tv_sec = buf.timestamp.tv_sec;
+    frame.timestamp.tv_nsec = buf.timestamp.tv_usec * 1000;
+    return true;
+}
+
+void V4L2FrameSource::release(unsigned int index)
+{
+    if (index < _numBuffers && _fd != -1) {
+        _queueBuffer(index);
+    }
+}
+
+/*
+ * FileFrameSource
+ */
+
+bool FileFrameSource::open()
+{
+    _file.open(_path, std::ios::binary);
+    if (!_file.is_open()) {
+        std::fprintf(stderr, "Failed to open recording %s\n", _path.c_str());
+        return false;
+    }
+
+    RecordingFileHeader header;
+    if (!_file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0 ||
+        header.version != RECORDING_VERSION) {
+        std::fprintf(stderr, "%s is not a frame recording\n", _path.c_str());
+        _file.close();
+        return false;
+    }
+    _firstFrameOffset = _file.tellg();
+
+    if (!_readPendingHeader()) {
+        std::fprintf(stderr, "Recording %s contains no frames\n", _path.c_str());
+        _file.close();
+        return false;
+    }
+    return true;
+}
+
+void FileFrameSource::close()
+{
+    if (_file.is_open()) {
+        _file.close();
+    }
+}
+
+bool FileFrameSource::_readPendingHeader()
+{
+    _havePending = static_cast<bool>(_file.read(reinterpret_cast<char*>(&_pending), sizeof(_pending)));
+    if (_havePending && !_pendingIsValid()) {
+        // Consumers read width * height * 2 bytes of YUYV, so a frame that
+        // does not hold that much must never reach them
+        std::fprintf(stderr, "Corrupt frame header in recording %s (%ux%u, format 0x%08x, %u bytes), "
+                             "stopping there\n",
+                     _path.c_str(), _pending.width, _pending.height, _pending.format, _pending.data_size);
+        _havePending = false;
+    }
+    return _havePending;
+}
+
+bool FileFrameSource::_pendingIsValid() const
+{
+    if (_pending.format != V4L2_PIX_FMT_YUYV || _pending.width == 0 || _pending.height == 0
+        || _pending.width % 2 != 0 || _pending.height % 2 != 0
+        || _pending.width > MAX_REPLAY_WIDTH || _pending.height > MAX_REPLAY_HEIGHT) {
+        return false;
+    }
+    // Drivers may pad the payload, but never below the packed size
+    uint64_t frame_bytes = static_cast<uint64_t>(_pending.width) * _pending.height * 2;
+    return _pending.data_size >= frame_bytes && _pending.data_size <= 2 * frame_bytes;
+}
+
+bool FileFrameSource::acquire(CapturedFrame& frame)
+{
+    if (_finished) {
+        return false;
+    }
+
+    if (!_havePending) {
+        if (!_loop) {
+            std::puts("Replay finished");
+            _finished = true;
+            return false;
+        }
+        // Rewind and restart the clock mapping for the next pass
+        _file.clear();
+        _file.seekg(_firstFrameOffset);
+        _baseSet = false;
+        if (!_readPendingHeader()) {
+            _finished = true;
+            return false;
+        }
+    }
+
+    uint64_t now = monotonicNowNs();
+    if (!_baseSet) {
+        _recordingBaseNs = _pending.timestamp_ns;
+        _clockBaseNs = now;
+        _lastTimestampNs = _pending.timestamp_ns;
+        _lastDueNs = now;
+        _baseSet = true;
+    }
+    if (_pending.timestamp_ns < _lastTimestampNs) {
+        // Time went backwards (e.g. recordings concatenated): treat it as a
+        // discontinuity and map this frame to right after the previous one,
+        // rather than to an unsigned wrap-around far in the future
+        _recordingBaseNs = _pending.timestamp_ns;
+        _clockBaseNs = _lastDueNs;
+    }
+
+    // Presentation time of the pending frame on our clock
+    uint64_t due = _clockBaseNs;
+    if (_speed > 0.0) {
+        due += static_cast<uint64_t>((_pending.timestamp_ns - _recordingBaseNs) / _speed);
+        if (now < due) {
+            return false; // Not due yet
+        }
+    }
+
+    // Find a buffer that no consumer is holding
+    unsigned int index = _numBuffers;
+    for (unsigned int i = 0; i < _numBuffers; ++i) {
+        if (!_bufferInUse[i].load(std::memory_order_acquire)) {
+            index = i;
+            break;
+        }
+    }
+    if (index == _numBuffers) {
+        return false; // All buffers held; retry on the next release
+    }
+
+    std::vector<unsigned char>& buffer = _buffers[index];
+    buffer.resize(_pending.data_size);
+    if (!_file.read(reinterpret_cast<char*>(buffer.data()), _pending.data_size)) {
+        std::fprintf(stderr, "Truncated frame in recording %s\n", _path.c_str());
+        _havePending = false;
+        return false;
+    }
+    _bufferInUse[index].store(true, std::memory_order_release);
+
+    frame.index = index;
+    frame.data = buffer.data();
+    frame.size = _pending.data_size;
+    frame.width = _pending.width;
+    frame.height = _pending.height;
+    frame.format = _pending.format;
+    frame.sequence = _sequence++;
+    frame.timestamp = nsToTimespec(_speed > 0.0 ? due : now);
+    _lastTimestampNs = _pending.timestamp_ns;
+    _lastDueNs = _speed > 0.0 ? due : now;
+
+    _readPendingHeader();
+    return true;
+}
+
+void FileFrameSource::release(unsigned int index)
+{
+    if (index < _numBuffers) {
+        _bufferInUse[index].store(false, std::memory_order_release);
+    }
+}
+
+/*
+ * FrameRecorder
+ */
+
+bool FrameRecorder::open(const std::string& path)
+{
+    _file.open(path, std::ios::binary | std::ios::trunc);
+    if (!_file.is_open()) {
+        std::fprintf(stderr, "Failed to open recording file %s\n", path.c_str());
+        return false;
+    }
+
+    RecordingFileHeader header = {};
+    memcpy(header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    header.version = RECORDING_VERSION;
+    _file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return true;
+}
+
+void FrameRecorder::write(const CapturedFrame& frame)
+{
+    if (!_file.is_open()) {
+        return;
+    }
+
+    RecordedFrameHeader header;
+    header.timestamp_ns = timespecToNs(frame.timestamp);
+    header.width = frame.width;
+    header.height = frame.height;
+    header.format = frame.format;
+    header.data_size = frame.size;
+    _file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    _file.write(static_cast<const char*>(frame.data), frame.size);
+}
+
+void FrameRecorder::close()
+{
+    if (_file.is_open()) {
+        _file.flush();
+        _file.close();
+    }
+}
@@ -1,268 +1,161 @@
-#include <linux/videodev2.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-#include <vector>
-#include <string>
+#include "ImageCapture.hpp"
+#include "FrameSource.hpp"
+#include "FrameBus.hpp"
+#include "LatencyTrace.hpp"
+#include "TimeUtils.hpp"
+#include <atomic>
+#include <memory>
 #include <cstring>
-#include <opencv2/opencv.hpp>
-#include <errno.h>
+#include <cstdio>
+#include <thread>
+#include <semaphore.h>
+#include <sys/resource.h>
 #include <zmq.hpp>
 
-static constexpr uint8_t NUM_OF_MEM_BUFFERS = 4;
-
-extern zmq::socket_t zmq_pub_socket; // PUB socket for ZeroMQ
-
-// Static buffer array to preserve original configurations
-static struct v4l2_buffer buffers[NUM_OF_MEM_BUFFERS];
-// Track buffer state (true = dequeued, false = queued)
-static bool buffer_dequeued[NUM_OF_MEM_BUFFERS] = {false};
-
-static int fd = -1;
-static bool cap_initialized = false;
-static void* buffer_starts[NUM_OF_MEM_BUFFERS] = {nullptr};
-static unsigned int buffer_lengths[NUM_OF_MEM_BUFFERS] = {0};
-static int width = 0;
-static int height = 0;
-static unsigned int next_overwrite_index = 0; // Tracks oldest buffer to overwrite
-// Callback to free the buffer after ZMQ is done sending
-void free_buffer(void* data, void* hint) {
-    struct BufferContext {
-        int fd;
-        unsigned int index;
-    };
-    BufferContext* context = static_cast<BufferContext*>(hint);
-    
-    // Mark buffer as dequeued
-    buffer_dequeued[context->index] = true;
-
-    // Re-queue the buffer using the original configuration
-    struct v4l2_buffer requeue_buf = buffers[context->index];
-    requeue_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    requeue_buf.memory = V4L2_MEMORY_MMAP;
-    requeue_buf.index = context->index;
-
-    if (ioctl(context->fd, VIDIOC_QBUF, &requeue_buf) != -1) {
-        buffer_dequeued[context->index] = false;
+static std::unique_ptr<FrameSource> source;
+static FramePool frame_pool;
+static uint64_t next_frame_id = 1;
+
+// --record: raw frames are written by a low-priority thread that takes them
+// off the frame bus like any other consumer, so the capture service never
+// waits on the disk. If the disk falls behind, the recording misses frames
+// (the frame bus counts them as dropped for "frameRecorder").
+static constexpr uint32_t RECORDER_POLL_MS = 100;
+static constexpr int RECORDER_NICE = 19;
+static FrameRecorder recorder;
+static int recorder_subscriber = -1;
+static std::thread recorder_thread;
+static sem_t recorder_wakeup;
+static std::atomic<bool> recorder_stopping{false};
+
+static void recordQueuedFrames()
+{
+    FrameRef shared;
+    while (frame_bus.poll(recorder_subscriber, shared)) {
+        const FrameMetadata& metadata = shared->metadata;
+        CapturedFrame frame = {};
+        frame.data = const_cast<void*>(shared->data);
+        frame.size = metadata.data_size;
+        frame.width = metadata.width;
+        frame.height = metadata.height;
+        frame.format = metadata.format;
+        frame.timestamp = nsToTimespec(metadata.capture_ns);
+        recorder.write(frame);
+        shared.reset();
     }
-    
-    delete context; // Clean up the context
 }
-void imageCaptureInit()
-{
-        // Open the video device
-        fd = open("/dev/video0", O_RDWR | O_NONBLOCK);
-        if (fd == -1) {
-            return;
-        }
-
-        // Query the camera's capabilities
-        struct v4l2_capability cap;
-        if (ioctl(fd, VIDIOC_QUERYCAP, &cap) == -1) {
-            close(fd);
-            return;
-        }
-        if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING)) {
-            close(fd);
-            return;
-        }
-
-        // Set the format
-        struct v4l2_format fmt;
-        memset(&fmt, 0, sizeof(fmt));
-        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        fmt.fmt.pix.width = 640;
-        fmt.fmt.pix.height = 480;
-        fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-        fmt.fmt.pix.field = V4L2_FIELD_ANY;
-        if (ioctl(fd, VIDIOC_S_FMT, &fmt) == -1) {
-            close(fd);
-            return;
-        }
-
-        // Verify the format and dimensions
-        if (fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV) {
-            close(fd);
-            return;
-        }
-        width = fmt.fmt.pix.width;
-        height = fmt.fmt.pix.height;
-
-        // Request buffers
-        struct v4l2_requestbuffers req;
-        memset(&req, 0, sizeof(req));
-        req.count = NUM_OF_MEM_BUFFERS;
-        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        req.memory = V4L2_MEMORY_MMAP;
-        if (ioctl(fd, VIDIOC_REQBUFS, &req) == -1 || req.count < NUM_OF_MEM_BUFFERS) {
-            close(fd);
-            return;
-        }
 
-        // Map and queue all buffers
-        for (unsigned int i = 0; i < NUM_OF_MEM_BUFFERS; ++i) {
-            memset(&buffers[i], 0, sizeof(buffers[i]));
-            buffers[i].type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buffers[i].memory = V4L2_MEMORY_MMAP;
-            buffers[i].index = i;
+static void recorderThread()
+{
+    if (setpriority(PRIO_PROCESS, 0, RECORDER_NICE) != 0) {
+        perror("setpriority(frame recorder) failed");
+    }
+    while (!recorder_stopping.load(std::memory_order_acquire)) {
+        struct timespec wake = nsToTimespec(monotonicNowNs() + RECORDER_POLL_MS * 1'000'000ULL);
+        sem_clockwait(&recorder_wakeup, CLOCK_MONOTONIC, &wake);
+        recordQueuedFrames();
+    }
+    recordQueuedFrames();
+}
 
-            if (ioctl(fd, VIDIOC_QUERYBUF, &buffers[i]) == -1) {
-                for (unsigned int j = 0; j < i; ++j) {
-                    munmap(buffer_starts[j], buffer_lengths[j]);
-                }
-                close(fd);
-                return;
-            }
+// Callback to drop the exported reference after ZMQ is done sending
+void free_frame_ref(void* data, void* hint) {
+    delete static_cast<FrameRef*>(hint);
+}
 
-            buffer_lengths[i] = buffers[i].length;
-            buffer_starts[i] = mmap(NULL, buffers[i].length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffers[i].m.offset);
-            if (buffer_starts[i] == MAP_FAILED) {
-                for (unsigned int j = 0; j < i; ++j) {
-                    munmap(buffer_starts[j], buffer_lengths[j]);
-                }
-                close(fd);
-                return;
-            }
+bool imageCaptureInit(const CaptureConfig& config)
+{
+    if (!config.replayFile.empty()) {
+        source = std::make_unique<FileFrameSource>(config.replayFile, config.replaySpeed, config.replayLoop,
+                                                   config.bufferCount);
+    } else {
+        source = std::make_unique<V4L2FrameSource>(config.device, config.bufferCount);
+    }
 
-            // Queue the buffer
-            if (ioctl(fd, VIDIOC_QBUF, &buffers[i]) == -1) {
-                for (unsigned int j = 0; j <= i; ++j) {
-                    munmap(buffer_starts[j], buffer_lengths[j]);
-                }
-                close(fd);
-                return;
-            }
-            buffer_dequeued[i] = false; // Initially queued
-        }
+    if (!source->open()) {
+        source.reset();
+        return false;
+    }
+    frame_pool.init(source.get());
 
-        // Start streaming
-        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        if (ioctl(fd, VIDIOC_STREAMON, &type) == -1) {
-            for (unsigned int i = 0; i < NUM_OF_MEM_BUFFERS; ++i) {
-                munmap(buffer_starts[i], buffer_lengths[i]);
-            }
-            close(fd);
-            return;
+    if (!config.recordFile.empty()) {
+        if (!recorder.open(config.recordFile)) {
+            source->close();
+            source.reset();
+            return false;
         }
+        recorder_subscriber = frame_bus.subscribe("frameRecorder");
+        sem_init(&recorder_wakeup, 0, 0);
+        frame_bus.setListener("frameRecorder", [] { sem_post(&recorder_wakeup); });
+        recorder_stopping.store(false, std::memory_order_relaxed);
+        recorder_thread = std::thread(recorderThread);
+    }
 
-        cap_initialized = true;
+    return true;
 }
 
-void imageCaptureService() {
-
-
-
-    // Non-blocking frame capture
-    struct v4l2_buffer buf;
-    memset(&buf, 0, sizeof(buf));
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
-
-    // Try to dequeue a buffer
-    if (ioctl(fd, VIDIOC_DQBUF, &buf) == -1) {
-        if (errno == EAGAIN) {
-            return;
-        }
-        return;
+void imageCaptureDeinit()
+{
+    if (recorder_thread.joinable()) {
+        recorder_stopping.store(true, std::memory_order_release);
+        sem_post(&recorder_wakeup);
+        recorder_thread.join();
+        sem_destroy(&recorder_wakeup);
     }
-
-    unsigned int buf_index = buf.index;
-    if (buf_index >= NUM_OF_MEM_BUFFERS) {
-        // Re-queue to avoid hanging
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = buf_index;
-        ioctl(fd, VIDIOC_QBUF, &buf);
-        return;
+    recorder.close();
+    // Queued frames still reference source buffers
+    frame_bus.clear();
+    if (source) {
+        frame_pool.logStatistics();
+        source->close();
     }
+}
 
-    // Update the static buffer array and mark as dequeued
-    buffers[buf_index] = buf;
-    buffer_dequeued[buf_index] = true;
-
-    // Send the raw frame data via ZMQ (non-blocking)
-    struct FrameMetadata {
-        int width;
-        int height;
-        uint32_t format;
-        size_t data_size;
-    };
-    FrameMetadata metadata = {width, height, V4L2_PIX_FMT_YUYV, buf.bytesused};
-
-    // Send metadata as the first part of a multi-part message
-    zmq::message_t metadata_msg(sizeof(FrameMetadata));
-    memcpy(metadata_msg.data(), &metadata, sizeof(FrameMetadata));
+// Publish a frame on the external ZMQ transport. The message references the
+// frame buffer directly and keeps it alive until ZMQ has sent it.
+static void exportFrame(const FrameRef& frame)
+{
+    zmq::message_t metadata_msg(&frame->metadata, sizeof(FrameMetadata));
     if (!zmq_pub_socket.send(metadata_msg, zmq::send_flags::sndmore | zmq::send_flags::dontwait)) {
-        // Re-queue the buffer
-        struct v4l2_buffer requeue_buf = buffers[buf_index];
-        requeue_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        requeue_buf.memory = V4L2_MEMORY_MMAP;
-        requeue_buf.index = buf_index;
-        if (ioctl(fd, VIDIOC_QBUF, &requeue_buf) != -1) {
-            buffer_dequeued[buf_index] = false;
-        }
         return;
     }
 
-    // Create a context to pass to the free callback
-    struct BufferContext {
-        int fd;
-        unsigned int index;
-    };
-    BufferContext* context = new BufferContext{fd, buf_index};
-
-    // Send the raw frame data as a pointer using zmq::message_t constructor
-    zmq::message_t frame_msg(buffer_starts[buf_index], buf.bytesused, free_buffer, context);
+    FrameRef* ref = new FrameRef(frame);
+    zmq::message_t frame_msg(const_cast<void*>(frame->data), frame->metadata.data_size, free_frame_ref, ref);
     if (!zmq_pub_socket.send(frame_msg, zmq::send_flags::dontwait)) {
-        // Clean up context since free_buffer won't be called
-        delete context;
-        // Re-queue the buffer
-        struct v4l2_buffer requeue_buf = buffers[buf_index];
-        requeue_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        requeue_buf.memory = V4L2_MEMORY_MMAP;
-        requeue_buf.index = buf_index;
-        if (ioctl(fd, VIDIOC_QBUF, &requeue_buf) != -1) {
-            buffer_dequeued[buf_index] = false;
-        }
+        // Clean up the reference since free_frame_ref won't be called
+        delete ref;
+    }
+}
+
+void imageCaptureService() {
+    if (!source) {
         return;
     }
 
-    // Try to queue a new buffer
-    bool queued = false;
-    for (unsigned int i = 0; i < NUM_OF_MEM_BUFFERS; ++i) {
-        unsigned int try_index = (next_overwrite_index + i) % NUM_OF_MEM_BUFFERS;
-        if (!buffer_dequeued[try_index]) {
-            continue;
-        }
+    CapturedFrame frame;
+    if (!source->acquire(frame)) {
+        frame_pool.noteNoFrame();
+        return;
+    }
 
-        struct v4l2_buffer try_buf = buffers[try_index];
-        try_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        try_buf.memory = V4L2_MEMORY_MMAP;
-        try_buf.index = try_index;
+    uint64_t frame_id = next_frame_id++;
+    uint64_t capture_ns = timespecToNs(frame.timestamp);
+    latencyTraceBegin(frame_id, capture_ns);
+    latencyTraceEnter(frame_id, Stage::Capture);
 
-        if (ioctl(fd, VIDIOC_QBUF, &try_buf) != -1) {
-            buffer_dequeued[try_index] = false;
-            next_overwrite_index = (try_index + 1) % NUM_OF_MEM_BUFFERS;
-            queued = true;
-            break;
-        }
+    FrameMetadata metadata = {frame.width, frame.height, frame.format, frame.size, frame_id, capture_ns};
+    FrameRef shared = frame_pool.wrap(frame, metadata);
+    if (!shared) {
+        return;
     }
 
-    if (!queued) {
-        // All buffers are in use; overwrite the oldest dequeued buffer
-        unsigned int overwrite_index = next_overwrite_index;
-        if (buffer_dequeued[overwrite_index]) {
-            struct v4l2_buffer overwrite_buf = buffers[overwrite_index];
-            overwrite_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            overwrite_buf.memory = V4L2_MEMORY_MMAP;
-            overwrite_buf.index = overwrite_index;
+    // Hand the same buffer to every in-process consumer
+    frame_bus.publish(shared);
 
-            if (ioctl(fd, VIDIOC_QBUF, &overwrite_buf) != -1) {
-                buffer_dequeued[overwrite_index] = false;
-                next_overwrite_index = (overwrite_index + 1) % NUM_OF_MEM_BUFFERS;
-            }
-        }
+    if (zmq_frame_export_enabled) {
+        exportFrame(shared);
     }
+
+    latencyTraceExit(frame_id, capture_ns, Stage::Capture);
 }
@@ -1,79 +1,190 @@
 #include "ImageProcessing.hpp"
+#include "LatencyTrace.hpp"
+#include "FrameBus.hpp"
+#include "PixelKernels.hpp"
+#include "PiMutex.hpp"
+#include "PupilDetection.hpp"
+#include "SpscRing.hpp"
+#include "TimeUtils.hpp"
 #include <linux/videodev2.h>
+#include <atomic>
+#include <cstdio>
 #include <iostream>
-#include <zmq.hpp>
+#include <mutex>
 
 using namespace cv;
 using namespace std;
 
-extern zmq::socket_t zmq_sub_socket_face; // ZMQ subscriber socket for frame input
-extern zmq::socket_t zmq_push_face_socket; // ZMQ push socket to send face center
+static int frame_subscriber = -1; // FrameBus subscription for frame input
 
 int detectiontype = 0;
-vector<Point> centers;
-Point track_Eyeball;
 using namespace cv;
 using namespace std;
 
 static bool initialized = false;
-static CascadeClassifier faceCascade;
-static CascadeClassifier eyeCascade;
 
-void initImageProcessingService(int type)
+// Face tracking: once a face is found, later frames only search a window
+// around it for a face of similar size. A full-frame scan runs again after
+// TRACK_MAX_MISSES misses in a row and every TRACK_FULL_SCAN_INTERVAL frames.
+static constexpr float FACE_SCALE_FACTOR = 1.1;
+static constexpr int FACE_MIN_NEIGHBOURS = 2;
+static constexpr int FULL_SCAN_MIN_FACE = 150;    // px at full resolution, smallest face a full scan accepts
+static constexpr double TRACK_SEARCH_MARGIN = 0.5;  // Window grows by this much of the face size per side
+static constexpr double TRACK_SIZE_TOLERANCE = 0.2; // Allowed change in face size between detections
+static constexpr int TRACK_MAX_MISSES = 2;
+static constexpr int TRACK_FULL_SCAN_INTERVAL = 30;
+
+// Results older than this (from capture) are dropped instead of moving the cursor
+static constexpr uint64_t STALE_RESULT_MS = 250;
+
+// Tracker state. Owned by DetectionService: it plans each frame's search and
+// folds the results back in frame order, so workers never touch it.
+struct FaceTrack {
+    bool enabled = true;
+    bool valid = false;  // lastFace may seed the next search
+    Rect lastFace;       // In luma coordinates
+    int misses = 0;
+    int framesSinceFullScan = 0;
+
+    uint64_t fullScans = 0;
+    uint64_t fullScanHits = 0;
+    uint64_t trackedScans = 0;
+    uint64_t trackedHits = 0;
+};
+static FaceTrack face_track;
+
+// One frame handed to a worker, with the search the tracker planned for it
+struct DetectionJob {
+    FrameRef frame;
+    bool fullScan = true;
+    Rect faceHint; // Last known face, seeds a tracked search
+};
+
+struct DetectionResult {
+    uint64_t frame_id = 0;
+    uint64_t capture_ns = 0;
+    bool fullScan = true;
+    bool faceFound = false;
+    Rect face;                // In luma coordinates, for the tracker
+    Point center = Point(-1, -1); // Full resolution, (-1, -1) when nothing was found
+    Mat overlay;              // Annotated frame when the debug overlay is on
+};
+
+// Everything one detection thread needs for itself: classifiers are not
+// safe to share between threads, buffers are reused across frames
+struct DetectionWorker {
+    CascadeClassifier faceCascade;
+    CascadeClassifier eyeCascade;
+    Mat grayFrame;  // Luma of the current frame
+    Mat eyeTable;   // Summed-area table for pupil scoring
+
+    SpscRing<DetectionJob, 2> jobs;         // DetectionService -> worker
+    SpscRing<DetectionResult, 2> results;   // worker -> DetectionService
+    std::atomic<bool> busy{false};          // Has a job queued or running
+    std::function<void()> listener;         // Releases the worker's service
+
+    uint64_t frames = 0;
+};
+static DetectionWorker detection_workers[MAX_DETECTION_WORKERS];
+static std::function<void()> detection_result_listener;
+
+// Frames given to workers, oldest first, until their result is delivered.
+// A worker can have one result waiting and its next job queued.
+static constexpr unsigned IN_FLIGHT_SLOTS = 2 * MAX_DETECTION_WORKERS;
+struct InFlightFrame {
+    uint64_t frame_id;
+    bool done;
+    DetectionResult result;
+};
+static InFlightFrame in_flight[IN_FLIGHT_SLOTS];
+static unsigned in_flight_head = 0;
+static unsigned in_flight_count = 0;
+
+static FrameRef waiting_frame; // Newest frame not yet taken by a worker
+static uint64_t skipped_frames = 0;
+static uint64_t stale_results = 0;
+
+static DetectionConfig detection_config;
+
+// Newest annotated frame for the debug window. DetectionService only drops it
+// here; the main thread shows it, since HighGUI may block for a long time.
+static Mat overlay_mailbox;
+static PiMutex overlay_mutex;
+static uint64_t overlays_dropped = 0; // Mailbox was busy, only touched by DetectionService
+
+static bool loadClassifiers(DetectionWorker& worker)
 {
-    detectiontype = type;
-	if(detectiontype==1)
-	{
-		if (!faceCascade.load("/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml")) {
-            cerr << "Failed to load face cascade classifier" << endl;
-            return;
-        }
-
-        initialized = true;
-	}
-	else if(detectiontype ==2)
-	{
-		if (!faceCascade.load("/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml")) {
+	if (!worker.faceCascade.load("/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml")) {
 		cerr << "Failed to load face cascade classifier" << endl;
-		return;
-        }
-        if (!eyeCascade.load("/usr/share/opencv4/haarcascades/haarcascade_eye.xml")) {
-            cerr << "Failed to load eye cascade classifier" << endl;
-            return;
-        }
-        initialized = true;
+		return false;
+	}
+	if (detectiontype == 2 && !worker.eyeCascade.load("/usr/share/opencv4/haarcascades/haarcascade_eye.xml")) {
+		cerr << "Failed to load eye cascade classifier" << endl;
+		return false;
 	}
+	return true;
 }
 
+// Every worker (or the one inline slot when there are none) gets its own classifiers
+static bool loadAllClassifiers()
+{
+    int slots = std::max(1, detection_config.workers);
+    for (int i = 0; i < slots; ++i) {
+        if (!loadClassifiers(detection_workers[i])) {
+            return false;
+        }
+    }
+    return true;
+}
 
+void initImageProcessingService(int type, const DetectionConfig& config)
+{
+    detectiontype = type;
+    detection_config = config;
+    detection_config.workers = std::clamp(config.workers, 0, MAX_DETECTION_WORKERS);
+    face_track.enabled = config.faceTracking;
+    frame_subscriber = frame_bus.subscribe("DetectionService");
+    initialized = loadAllClassifiers();
+}
 
-Vec3f eyeBallDetection(Mat& eye, vector<Vec3f>& circles) {
-    vector<int> sums(circles.size(), 0);
-    for (int y = 0; y < eye.rows; y++) {
-        uchar* data = eye.ptr<uchar>(y);
-        for (int x = 0; x < eye.cols; x++) {
-            int pixel_value = static_cast<int>(*data);
-            for (int i = 0; i < circles.size(); i++) {
-                Point center((int)round(circles[i][0]), (int)round(circles[i][1]));
-                int radius = (int)round(circles[i][2]);
-                if (pow(x - center.x, 2) + pow(y - center.y, 2) < pow(radius, 2)) {
-                    sums[i] += pixel_value;
-                }
-            }
-            ++data;
-        }
+void showDetectionOverlay()
+{
+    Mat overlay;
+    {
+        std::lock_guard<PiMutex> lock(overlay_mutex);
+        std::swap(overlay, overlay_mailbox);
     }
-    int smallestSum = 9999999;
-    int smallestSumIndex = -1;
-    for (int i = 0; i < circles.size(); i++) {
-        if (sums[i] < smallestSum) {
-            smallestSum = sums[i];
-            smallestSumIndex = i;
+    if (overlay.data) {
+        imshow("Detection", overlay);
+    }
+    waitKey(1);
+}
+
+void deinitImageProcessingService()
+{
+    // Frames still parked here must go back to the source before it closes
+    waiting_frame.reset();
+    DetectionJob job;
+    for (DetectionWorker& worker : detection_workers) {
+        while (worker.jobs.pop(job)) {
+            job.frame.reset();
         }
     }
-    return circles[smallestSumIndex];
 }
 
+void setDetectionWorkerListener(int index, std::function<void()> listener)
+{
+    if (index >= 0 && index < MAX_DETECTION_WORKERS) {
+        detection_workers[index].listener = std::move(listener);
+    }
+}
+
+void setDetectionResultListener(std::function<void()> listener)
+{
+    detection_result_listener = std::move(listener);
+}
+
+
 Rect detectLeftEye(vector<Rect>& eyes) {
     int leftEye = 99999999;
     int index = 0;
@@ -87,52 +198,147 @@ Rect detectLeftEye(vector<Rect>& eyes) {
 }
 
 
-Point makeStable(vector<Point>& points, int iteration) {
-    float sum_of_X = 0, sum_of_Y = 0;
-    int count = 0;
-    int j = max(0, (int)(points.size() - iteration));
-    int number_of_points = points.size();
-    for (; j < number_of_points; j++) {
-        sum_of_X += points[j].x;
-        sum_of_Y += points[j].y;
-        ++count;
+// Equalize and search only the window around the given face
+static bool detectTrackedFace(Mat& grayImage, CascadeClassifier& faceCascade, const Rect& last, Rect& face)
+{
+    int marginX = static_cast<int>(last.width * TRACK_SEARCH_MARGIN);
+    int marginY = static_cast<int>(last.height * TRACK_SEARCH_MARGIN);
+    Rect window = Rect(last.x - marginX, last.y - marginY, last.width + 2 * marginX, last.height + 2 * marginY)
+                  & Rect(0, 0, grayImage.cols, grayImage.rows);
+
+    int minSide = static_cast<int>(std::min(last.width, last.height) * (1.0 - TRACK_SIZE_TOLERANCE));
+    int maxSide = static_cast<int>(std::max(last.width, last.height) * (1.0 + TRACK_SIZE_TOLERANCE));
+
+    Mat searchArea = grayImage(window);
+    equalizeHist(searchArea, searchArea);
+
+    vector<Rect> faces;
+    faceCascade.detectMultiScale(searchArea, faces, FACE_SCALE_FACTOR, FACE_MIN_NEIGHBOURS, 0 | CASCADE_SCALE_IMAGE,
+                                 Size(minSide, minSide), Size(maxSide, maxSide));
+    if (faces.empty()) {
+        return false;
+    }
+    face = faces[0] + window.tl();
+    return true;
+}
+
+static bool detectFullFrameFace(Mat& grayImage, CascadeClassifier& faceCascade, Rect& face)
+{
+    equalizeHist(grayImage, grayImage);
+
+    vector<Rect> faces;
+    faceCascade.detectMultiScale(grayImage, faces, FACE_SCALE_FACTOR, FACE_MIN_NEIGHBOURS, 0 | CASCADE_SCALE_IMAGE,
+                                 Size(FULL_SCAN_MIN_FACE / detection_config.lumaDecimation,
+                                      FULL_SCAN_MIN_FACE / detection_config.lumaDecimation));
+    if (faces.empty()) {
+        return false;
     }
-    if (count > 0) {
-        sum_of_X /= count;
-        sum_of_Y /= count;
+    face = faces[0];
+    return true;
+}
+
+// Find the face in a grayscale frame the way the job says. The part of
+// grayImage that was searched is left equalized.
+static bool detectFace(Mat& grayImage, CascadeClassifier& faceCascade, const DetectionJob& job, Rect& face)
+{
+    if (job.fullScan) {
+        return detectFullFrameFace(grayImage, faceCascade, face);
     }
-    return Point(sum_of_X, sum_of_Y);
+    return detectTrackedFace(grayImage, faceCascade, job.faceHint, face);
 }
 
-void eyeCenterDetection(Mat& frame, CascadeClassifier& faceCascade, CascadeClassifier& eyeCascade, Point& eyeCenter) {
-    cv::Mat grayImage;
-    cv::cvtColor(frame, grayImage, cv::COLOR_BGR2GRAY);
-    cv::equalizeHist(grayImage, grayImage);
+// Decide how the next frame is searched
+static void planFaceSearch(DetectionJob& job)
+{
+    job.fullScan = !face_track.enabled || !face_track.valid
+                   || face_track.misses >= TRACK_MAX_MISSES
+                   || face_track.framesSinceFullScan >= TRACK_FULL_SCAN_INTERVAL;
+    job.faceHint = face_track.lastFace;
+    if (job.fullScan) {
+        face_track.framesSinceFullScan = 0;
+    } else {
+        face_track.framesSinceFullScan++;
+    }
+}
 
-    // Detect faces
-    std::vector<cv::Rect> faces;
-    float scaleFactor = 1.1;
-    int minimumNeighbour = 2;
-    cv::Size minImageSize = cv::Size(150, 150);
-    faceCascade.detectMultiScale(grayImage, faces, scaleFactor, minimumNeighbour, 0 | cv::CASCADE_SCALE_IMAGE, minImageSize);
+// Fold a result back into the tracker, in frame order
+static void updateFaceTrack(const DetectionResult& result)
+{
+    if (result.fullScan) {
+        face_track.fullScans++;
+        face_track.fullScanHits += result.faceFound;
+    } else {
+        face_track.trackedScans++;
+        face_track.trackedHits += result.faceFound;
+    }
 
-    if (faces.empty()) {
-        eyeCenter = cv::Point(-1, -1); // No face detected
-        return;
+    if (result.faceFound) {
+        face_track.lastFace = result.face;
+        face_track.valid = true;
+        face_track.misses = 0;
+    } else {
+        face_track.misses++;
+        if (result.fullScan) {
+            face_track.valid = false;
+        }
+    }
+}
+
+void logDetectionStatistics()
+{
+    std::printf("Face detection: %llu full scans (%llu hits), %llu tracked scans (%llu hits)\n",
+                static_cast<unsigned long long>(face_track.fullScans),
+                static_cast<unsigned long long>(face_track.fullScanHits),
+                static_cast<unsigned long long>(face_track.trackedScans),
+                static_cast<unsigned long long>(face_track.trackedHits));
+    std::printf("  %llu frames skipped while all workers were busy, %llu stale results dropped\n",
+                static_cast<unsigned long long>(skipped_frames),
+                static_cast<unsigned long long>(stale_results));
+    if (detection_config.overlay) {
+        std::printf("  %llu overlays dropped while the window was being updated\n",
+                    static_cast<unsigned long long>(overlays_dropped));
+    }
+    for (int i = 0; i < detection_config.workers; ++i) {
+        std::printf("  worker %d: %llu frames\n", i, static_cast<unsigned long long>(detection_workers[i].frames));
     }
+}
+
+// Luma of a YUYV frame into gray, reusing its buffer; decimation 2 or 4
+// box-filters the frame down by that factor
+static void extractLuma(const Mat& yuyv, Mat& gray, int decimation)
+{
+    gray.create(yuyv.rows / decimation, yuyv.cols / decimation, CV_8UC1);
+    yuyvToYDecimated(yuyv.data, yuyv.step, gray.data, gray.step, yuyv.cols, yuyv.rows, decimation);
+}
+
+// grayImage is the (possibly decimated) luma of the frame; the eye center
+// is reported at full resolution
+void eyeCenterDetection(DetectionWorker& worker, const DetectionJob& job, DetectionResult& result, Mat* overlay) {
+    int scale = detection_config.lumaDecimation;
+    Mat& grayImage = worker.grayFrame;
+
+    // Detect faces
+    cv::Rect face;
+    if (!detectFace(grayImage, worker.faceCascade, job, face)) {
+        return; // No face detected
+    }
+    result.faceFound = true;
+    result.face = face;
     
-    Mat grayface = grayImage(faces[0]);
+    Mat grayface = grayImage(face);
     
     // Detect eyes
     vector<Rect> eyes;
     float eyeScaleFactor = 1.1;
     int eyeMinimumNeighbour = 2;
-    Size eyeMinImageSize = Size(30, 30);
-    eyeCascade.detectMultiScale(grayface, eyes, eyeScaleFactor, eyeMinimumNeighbour, 0 | CASCADE_SCALE_IMAGE, eyeMinImageSize);
+    Size eyeMinImageSize = Size(30 / scale, 30 / scale);
+    worker.eyeCascade.detectMultiScale(grayface, eyes, eyeScaleFactor, eyeMinimumNeighbour, 0 | CASCADE_SCALE_IMAGE, eyeMinImageSize);
     if (eyes.size() != 2) return;
 
-    for (Rect& eye : eyes) {
-        rectangle(frame, faces[0].tl() + eye.tl(), faces[0].tl() + eye.br(), Scalar(0, 255, 0), 2);
+    if (overlay) {
+        for (Rect& eye : eyes) {
+            rectangle(*overlay, (face.tl() + eye.tl()) * scale, (face.tl() + eye.br()) * scale, Scalar(0, 255, 0), 2);
+        }
     }
     
     Rect eyeRect = detectLeftEye(eyes);
@@ -140,256 +346,237 @@ void eyeCenterDetection(Mat& frame, CascadeClassifier& faceCascade, CascadeClass
     equalizeHist(eye, eye);
     
     vector<Vec3f> circles;
-    int method = 3;
-    int detect_Pixel = 1;
-    int minimum_Distance = eye.cols / 8;
-    int threshold = 250;
-    int minimum_Area = 15;
-    int minimum_Radius = eye.rows / 6;
-    int maximum_Radius = eye.rows / 2;
-    HoughCircles(eye, circles, HOUGH_GRADIENT, detect_Pixel, minimum_Distance, threshold, minimum_Area, minimum_Radius, maximum_Radius);
+    findPupilCandidates(eye, circles);
     
-    if (circles.size()>0) {
-        Vec3f eyeball = eyeBallDetection(eye, circles);
-      
-        cv::Point eyeCenters = cv::Point(cvRound(eyeball[0]), cvRound(eyeball[1]));
-        centers.push_back(eyeCenters);
-        eyeCenters = makeStable(centers, 5);
-        track_Eyeball = eyeCenter;
-        int radius = (int)eyeball[2];
-        //eyeCenter = faces[0].tl() + eyeRect.tl() + eyeCenters;
-        eyeCenter = eyeCenters;
-        
+    Vec3f eyeball;
+    if (eyeBallDetection(eye, circles, eyeball, worker.eyeTable)) {
+        //result.center = face.tl() + eyeRect.tl() + eyeball center;
+        result.center = cv::Point(cvRound(eyeball[0] * scale), cvRound(eyeball[1] * scale));
     }
-    
-    
 }
 
-void eyeCenterDetectionService() {
+// grayImage is the (possibly decimated) luma of the frame; the face center
+// is reported at full resolution
+void faceCenterDetection(DetectionWorker& worker, const DetectionJob& job, DetectionResult& result, Mat* overlay) {
+    int scale = detection_config.lumaDecimation;
 
-    
-    // Initialize face and eye classifier
-    if (!initialized) {
-        if (!faceCascade.load("/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml")) {
-            cerr << "Failed to load face cascade classifier" << endl;
-            return;
-        }
-        if (!eyeCascade.load("/usr/share/opencv4/haarcascades/haarcascade_eye.xml")) {
-            cerr << "Failed to load eye cascade classifier" << endl;
-            return;
-        }
-        initialized = true;
+    // Detect faces
+    Rect faceRect;
+    if (!detectFace(worker.grayFrame, worker.faceCascade, job, faceRect)) {
+        return; // No face detected
     }
+    result.faceFound = true;
+    result.face = faceRect;
 
-    // Non-blocking receive loop
-    while (true) {
-        // Receive the metadata (first part of the multi-part message)
-        zmq::message_t metadata_msg;
-        if (!zmq_sub_socket_face.recv(metadata_msg, zmq::recv_flags::dontwait)) {
-            break; // No message available, exit loop
-        }
+    // Process the detected face at full resolution
+    faceRect = Rect(faceRect.x * scale, faceRect.y * scale, faceRect.width * scale, faceRect.height * scale);
 
-        // Ensure the second part (frame data) is available
-        if (!metadata_msg.more()) {
-            cerr << "Missing frame data part in ZMQ message" << endl;
-            continue;
-        }
-
-        // Extract metadata
-        struct FrameMetadata {
-            int width;
-            int height;
-            uint32_t format;
-            size_t data_size;
-        };
-        if (metadata_msg.size() != sizeof(FrameMetadata)) {
-            cerr << "Invalid metadata size received" << endl;
-            continue;
-        }
-        FrameMetadata metadata;
-        memcpy(&metadata, metadata_msg.data(), sizeof(FrameMetadata));
-
-        // Verify format
-        if (metadata.format != V4L2_PIX_FMT_YUYV) {
-            cerr << "Unsupported frame format: " << metadata.format << endl;
-            continue;
-        }
-
-        // Receive the raw frame data (second part)
-        zmq::message_t frame_msg;
-        if (!zmq_sub_socket_face.recv(frame_msg, zmq::recv_flags::dontwait)) {
-            cerr << "Failed to receive frame data" << endl;
-            continue;
-        }
-
-        if (frame_msg.size() != metadata.data_size) {
-            cerr << "Frame data size mismatch: expected " << metadata.data_size
-                 << ", received " << frame_msg.size() << endl;
-            continue;
-        }
-
-        // Create a cv::Mat from the raw YUYV data
-        Mat yuyv(metadata.height, metadata.width, CV_8UC2, frame_msg.data());
-        Mat frame;
-        try {
-            cvtColor(yuyv, frame, COLOR_YUV2BGR_YUYV);
-        } catch (const cv::Exception& e) {
-            cerr << "Color conversion failed: " << e.what() << endl;
-            continue;
-        }
-        if (frame.empty()) {
-            cerr << "Failed to convert frame to BGR" << endl;
-            continue;
-        }
+    // Calculate the center of the face
+    result.center = Point(faceRect.x + faceRect.width / 2, faceRect.y + faceRect.height / 2);
+
+    if (overlay) {
+        int x = faceRect.x;
+        int y = faceRect.y;
+        int h = y + faceRect.height;
+        int w = x + faceRect.width;
+        rectangle(*overlay, Point(x, y), Point(w, h), Scalar(255, 0, 255), 2, 8, 0);
+
+        // Draw a circle at the center of the face
+        int radius = faceRect.width / 8;
+        circle(*overlay, result.center, radius, Scalar(0, 0, 255), 2);
+    }
+}
 
+// Detect on one frame with the worker's own classifiers and buffers
+static void runDetection(DetectionWorker& worker, DetectionJob& job, DetectionResult& result)
+{
+    const FrameMetadata& metadata = job.frame->metadata;
+    latencyTraceEnter(metadata.frame_id, Stage::Detection);
+
+    result = DetectionResult();
+    result.frame_id = metadata.frame_id;
+    result.capture_ns = metadata.capture_ns;
+    result.fullScan = job.fullScan;
+
+    // Wrap the shared YUYV buffer in a cv::Mat without copying and pull
+    // the luma the cascades work on straight out of it
+    Mat yuyv(metadata.height, metadata.width, CV_8UC2, const_cast<void*>(job.frame->data));
+    extractLuma(yuyv, worker.grayFrame, detection_config.lumaDecimation);
+
+    // The overlay gets a fresh Mat per frame since it travels with the result
+    Mat* overlay = nullptr;
+    if (detection_config.overlay) {
+        result.overlay.create(yuyv.rows, yuyv.cols, CV_8UC3);
+        yuyvToBgr(yuyv.data, yuyv.step, result.overlay.data, result.overlay.step, yuyv.cols, yuyv.rows);
+        overlay = &result.overlay;
+    }
 
-        Point eyeCenter;
-        eyeCenterDetection(frame, faceCascade,eyeCascade, eyeCenter);
+    if (detectiontype == 1) {
+        faceCenterDetection(worker, job, result, overlay);
+    } else {
+        eyeCenterDetection(worker, job, result, overlay);
+    }
 
+    // Give the capture buffer back as soon as possible
+    job.frame.reset();
+    worker.frames++;
+    latencyTraceExit(result.frame_id, result.capture_ns, Stage::Detection);
+}
 
-        // Send face center coordinates via ZeroMQ
-        if (eyeCenter.x >= 0 && eyeCenter.y >= 0) {
-            char buffer[50];
-            snprintf(buffer, sizeof(buffer), "Center:%d,%d", eyeCenter.x, eyeCenter.y);
-            zmq::message_t msg(buffer, strlen(buffer));
-            zmq_push_face_socket.send(msg, zmq::send_flags::dontwait);
+// Deliver a result in frame order: update the tracker and hand the center
+// to cursorTranslationService unless it is too old to be useful
+static void emitResult(DetectionResult& result)
+{
+    updateFaceTrack(result);
+
+    if (result.overlay.data) {
+        // Never wait for the main thread: a busy mailbox drops this overlay
+        std::unique_lock<PiMutex> lock(overlay_mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            std::swap(overlay_mailbox, result.overlay);
+        } else {
+            overlays_dropped++;
         }
-
-        // imshow("Webcam", frame);
-        // if (waitKey(30) >= 0) break;
     }
-}
-
-void faceCenterDetection(Mat& frame, CascadeClassifier& faceCascade, Point& faceCenter) {
-    Mat grayImage;
-    cvtColor(frame, grayImage, COLOR_BGR2GRAY);
-    equalizeHist(grayImage, grayImage);
 
-    // Detect faces
-    vector<Rect> storedFaces;
-    float scaleFactor = 1.1;
-    int minimumNeighbour = 2;
-    Size minImageSize = Size(150, 150);
-    faceCascade.detectMultiScale(grayImage, storedFaces, scaleFactor, minimumNeighbour, 0 | CASCADE_SCALE_IMAGE, minImageSize);
-    if (storedFaces.empty()) {
-        faceCenter = Point(-1, -1); // Indicate no face detected
+    if (result.center.x < 0 || result.center.y < 0) {
+        return;
+    }
+    if (monotonicNowNs() - result.capture_ns > STALE_RESULT_MS * 1'000'000ULL) {
+        stale_results++;
         return;
     }
 
-    // Process the first detected face
-    Rect faceRect = storedFaces[0];
-    int x = faceRect.x;
-    int y = faceRect.y;
-    int h = y + faceRect.height;
-    int w = x + faceRect.width;
-    rectangle(frame, Point(x, y), Point(w, h), Scalar(255, 0, 255), 2, 8, 0);
-
-    // Calculate the center of the face
-    faceCenter = Point(faceRect.x + faceRect.width / 2, faceRect.y + faceRect.height / 2);
-
-    // Draw a circle at the center of the face
-    int radius = faceRect.width / 8;
-    circle(frame, faceCenter, radius, Scalar(0, 0, 255), 2);
+    // Hand the center to cursorTranslationService, which does the smoothing
+    CenterMessage message = {result.frame_id, result.capture_ns, result.center.x, result.center.y};
+    if (face_center_queue.push(message) && face_center_listener) {
+        face_center_listener();
+    }
 }
 
-void faceCenterDetectionService() {
-
-    // Initialize face classifier
-    if (!initialized) {
-        if (!faceCascade.load("/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml")) {
-            cerr << "Failed to load face cascade classifier" << endl;
-            return;
+// Collect finished work from every worker and deliver what is next in order
+static void collectResults()
+{
+    for (int i = 0; i < detection_config.workers; ++i) {
+        DetectionResult result;
+        while (detection_workers[i].results.pop(result)) {
+            for (unsigned n = 0; n < in_flight_count; ++n) {
+                InFlightFrame& slot = in_flight[(in_flight_head + n) % IN_FLIGHT_SLOTS];
+                if (slot.frame_id == result.frame_id) {
+                    slot.result = std::move(result);
+                    slot.done = true;
+                    break;
+                }
+            }
         }
-        initialized = true;
     }
 
-    // Non-blocking receive loop
-    while (true) {
-        // Receive the metadata (first part of the multi-part message)
-        zmq::message_t metadata_msg;
-        if (!zmq_sub_socket_face.recv(metadata_msg, zmq::recv_flags::dontwait)) {
-            break; // No message available, exit loop
-        }
-
-        // Ensure the second part (frame data) is available
-        if (!metadata_msg.more()) {
-            cerr << "Missing frame data part in ZMQ message" << endl;
-            continue;
-        }
-
-        // Extract metadata
-        struct FrameMetadata {
-            int width;
-            int height;
-            uint32_t format;
-            size_t data_size;
-        };
-        if (metadata_msg.size() != sizeof(FrameMetadata)) {
-            cerr << "Invalid metadata size received" << endl;
-            continue;
-        }
-        FrameMetadata metadata;
-        memcpy(&metadata, metadata_msg.data(), sizeof(FrameMetadata));
+    while (in_flight_count > 0 && in_flight[in_flight_head].done) {
+        InFlightFrame& slot = in_flight[in_flight_head];
+        emitResult(slot.result);
+        slot.result = DetectionResult();
+        slot.done = false;
+        in_flight_head = (in_flight_head + 1) % IN_FLIGHT_SLOTS;
+        in_flight_count--;
+    }
+}
 
+// Take the newest frame off the bus; anything older it replaces is skipped
+static void takeNewestFrame()
+{
+    FrameRef frame;
+    while (frame_bus.poll(frame_subscriber, frame)) {
         // Verify format
-        if (metadata.format != V4L2_PIX_FMT_YUYV) {
-            cerr << "Unsupported frame format: " << metadata.format << endl;
+        if (frame->metadata.format != V4L2_PIX_FMT_YUYV) {
+            cerr << "Unsupported frame format: " << frame->metadata.format << endl;
             continue;
         }
-
-        // Receive the raw frame data (second part)
-        zmq::message_t frame_msg;
-        if (!zmq_sub_socket_face.recv(frame_msg, zmq::recv_flags::dontwait)) {
-            cerr << "Failed to receive frame data" << endl;
+        if (!frameHoldsYuyv(frame->metadata)) {
+            cerr << "Frame data size mismatch: " << frame->metadata.data_size << " bytes for "
+                 << frame->metadata.width << "x" << frame->metadata.height << endl;
             continue;
         }
-
-        if (frame_msg.size() != metadata.data_size) {
-            cerr << "Frame data size mismatch: expected " << metadata.data_size
-                 << ", received " << frame_msg.size() << endl;
-            continue;
+        if (waiting_frame) {
+            skipped_frames++;
         }
+        waiting_frame = std::move(frame);
+    }
+}
 
-        // Create a cv::Mat from the raw YUYV data
-        Mat yuyv(metadata.height, metadata.width, CV_8UC2, frame_msg.data());
-        Mat frame;
-        try {
-            cvtColor(yuyv, frame, COLOR_YUV2BGR_YUYV);
-        } catch (const cv::Exception& e) {
-            cerr << "Color conversion failed: " << e.what() << endl;
-            continue;
-        }
-        if (frame.empty()) {
-            cerr << "Failed to convert frame to BGR" << endl;
+// Hand the waiting frame to an idle worker, if there is one
+static void dispatchFrame()
+{
+    if (!waiting_frame || in_flight_count == IN_FLIGHT_SLOTS) {
+        return;
+    }
+    for (int i = 0; i < detection_config.workers; ++i) {
+        DetectionWorker& worker = detection_workers[i];
+        if (worker.busy.load(std::memory_order_acquire)) {
             continue;
         }
 
+        DetectionJob job;
+        job.frame = std::move(waiting_frame);
+        planFaceSearch(job);
 
-        Point faceCenter;
-        faceCenterDetection(frame, faceCascade, faceCenter);
+        InFlightFrame& slot = in_flight[(in_flight_head + in_flight_count) % IN_FLIGHT_SLOTS];
+        slot.frame_id = job.frame->metadata.frame_id;
+        slot.done = false;
+        in_flight_count++;
 
-
-        // Send face center coordinates via ZeroMQ
-        if (faceCenter.x >= 0 && faceCenter.y >= 0) {
-            char buffer[50];
-            snprintf(buffer, sizeof(buffer), "Center:%d,%d", faceCenter.x, faceCenter.y);
-            zmq::message_t msg(buffer, strlen(buffer));
-            zmq_push_face_socket.send(msg, zmq::send_flags::dontwait);
+        worker.busy.store(true, std::memory_order_release);
+        worker.jobs.push(std::move(job));
+        if (worker.listener) {
+            worker.listener();
         }
+        return;
+    }
+}
 
-        // imshow("Webcam", frame);
-        // if (waitKey(30) >= 0) break;
+// Runs on each worker's own service thread
+void detectionWorkerService(int index)
+{
+    if (index < 0 || index >= detection_config.workers) {
+        return;
+    }
+    DetectionWorker& worker = detection_workers[index];
+
+    DetectionJob job;
+    while (worker.jobs.pop(job)) {
+        DetectionResult result;
+        runDetection(worker, job, result);
+        worker.results.push(std::move(result));
+        worker.busy.store(false, std::memory_order_release);
+        if (detection_result_listener) {
+            detection_result_listener();
+        }
     }
 }
 
+// With workers, DetectionService only reorders results and hands out
+// frames; without, it detects on the newest frame itself
 void DetectionService()
 {
-    if(detectiontype == 1)
-    {
-        faceCenterDetectionService();
+    if (!initialized) {
+        initialized = loadAllClassifiers();
+        if (!initialized) {
+            return;
+        }
     }
-    else if(detectiontype == 2)
-    {
-        eyeCenterDetectionService();
+
+    takeNewestFrame();
+    if (detection_config.workers == 0) {
+        if (waiting_frame) {
+            DetectionJob job;
+            job.frame = std::move(waiting_frame);
+            planFaceSearch(job);
+            DetectionResult result;
+            runDetection(detection_workers[0], job, result);
+            emitResult(result);
+        }
+        return;
     }
+
+    collectResults();
+    dispatchFrame();
 }
@@ -0,0 +1,449 @@
+#include "ImageWriter.hpp"
+#include "Metrics.hpp"
+#include "PiMutex.hpp"
+#include "SegmentFormat.hpp"
+#include "TimeUtils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+// The writer runs below every service: normal scheduling at the lowest
+// weight and the lowest best-effort I/O priority
+static constexpr int WRITER_NICE = 19;
+static constexpr int IOPRIO_CLASS_BE = 2;
+static constexpr int IOPRIO_CLASS_SHIFT = 13;
+static constexpr int IOPRIO_LOWEST_LEVEL = 7;
+static constexpr int IOPRIO_WHO_PROCESS = 1;
+
+static constexpr size_t MAX_WRITE_BATCH = 32;
+static constexpr unsigned URING_ENTRIES = 2; // Data and index write of one batch
+
+struct QueuedImage {
+    std::vector<unsigned char> data; // The image, possibly followed by stale bytes
+    size_t size = 0;
+    uint64_t frameId = 0;
+    uint64_t timestampNs = 0;
+};
+
+// The segment being appended to; only touched by the writer thread
+struct OpenSegment {
+    int dataFd = -1;
+    int indexFd = -1;
+    uint32_t number = 0;
+    uint64_t openedNs = 0;
+    uint64_t dataSize = 0;
+    uint64_t indexSize = 0;
+};
+
+static ImageWriterConfig writer_config;
+static bool writer_initialized = false;
+
+// Ring of queue_depth slots guarded by queue_mutex; writer_wakeup is posted
+// on every submit and at shutdown, the writer drains whatever it finds
+static std::vector<QueuedImage> queue_slots;
+static size_t queue_head = 0;
+static size_t queue_count = 0;
+static size_t queue_high_water = 0;
+static PiMutex queue_mutex;
+static sem_t writer_wakeup;
+static std::atomic<bool> writer_stopping{false};
+static std::thread writer_thread;
+
+static std::atomic<uint64_t> images_submitted{0};
+static std::atomic<uint64_t> images_written{0};
+static std::atomic<uint64_t> images_dropped{0};
+static std::atomic<uint64_t> images_failed{0};
+static std::atomic<uint64_t> batches_written{0};
+static std::atomic<uint64_t> segments_opened{0};
+
+static OpenSegment segment;
+static uint32_t next_segment = 0;
+static bool preallocation_warned = false;
+
+#ifdef HAVE_LIBURING
+static struct io_uring writer_ring;
+static bool uring_ready = false; // False falls back to pwritev, e.g. io_uring disabled by sysctl
+#endif
+
+static void lowerWriterPriority()
+{
+    // PRIO_PROCESS with who = 0 affects only the calling thread on Linux
+    if (setpriority(PRIO_PROCESS, 0, WRITER_NICE) != 0) {
+        perror("setpriority(image writer) failed");
+    }
+    int ioprio = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | IOPRIO_LOWEST_LEVEL;
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) != 0) {
+        perror("ioprio_set(image writer) failed");
+    }
+}
+
+// Write all of iov at offset, resuming after short writes
+static bool pwritevAll(int fd, struct iovec* iov, int count, uint64_t offset)
+{
+    while (count > 0) {
+        ssize_t n = pwritev(fd, iov, std::min(count, IOV_MAX), static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        offset += n;
+        while (count > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+static void closeSegment()
+{
+    if (segment.dataFd >= 0) {
+        // Give back the preallocated space the segment did not use
+        if (ftruncate(segment.dataFd, static_cast<off_t>(segment.dataSize)) != 0) {
+            perror("ftruncate(segment) failed");
+        }
+        close(segment.dataFd);
+    }
+    if (segment.indexFd >= 0) {
+        close(segment.indexFd);
+    }
+    segment = OpenSegment{};
+}
+
+static bool openSegment()
+{
+    uint32_t number = next_segment++;
+    std::string data_path = segmentFileName(writer_config.directory, number, "mjpg");
+    std::string index_path = segmentFileName(writer_config.directory, number, "idx");
+    segment.number = number;
+    segment.openedNs = monotonicNowNs();
+    segment.dataFd = open(data_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    segment.indexFd = open(index_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (segment.dataFd < 0 || segment.indexFd < 0) {
+        std::fprintf(stderr, "Failed to open segment %u: %s\n", number, strerror(errno));
+        closeSegment();
+        return false;
+    }
+
+    // Reserve the whole segment up front so appends never allocate blocks;
+    // KEEP_SIZE leaves the file size at what was actually written
+    if (fallocate(segment.dataFd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(writer_config.segmentBytes)) != 0
+        && !preallocation_warned) {
+        std::fprintf(stderr, "Segment preallocation unavailable: %s\n", strerror(errno));
+        preallocation_warned = true;
+    }
+
+    SegmentIndexHeader header = {};
+    memcpy(header.magic, SEGMENT_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SEGMENT_INDEX_VERSION;
+    header.segment = number;
+    header.createdNs = segment.openedNs;
+    if (pwrite(segment.indexFd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+        std::fprintf(stderr, "Failed to write segment %u index header\n", number);
+        closeSegment();
+        return false;
+    }
+    segment.indexSize = sizeof(header);
+    segments_opened.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Make sure an image of `size` bytes can be appended, rotating if needed
+static bool segmentFor(size_t size)
+{
+    if (segment.dataFd >= 0 && segment.dataSize > 0) {
+        bool full = segment.dataSize + size > writer_config.segmentBytes;
+        bool expired = writer_config.segmentSeconds > 0
+            && monotonicNowNs() - segment.openedNs >= writer_config.segmentSeconds * 1'000'000'000ULL;
+        if (full || expired) {
+            closeSegment();
+        }
+    }
+    return segment.dataFd >= 0 || openSegment();
+}
+
+// Append images [first, first + count) to the open segment: all payloads in
+// one vectored write, then their index entries in a second one
+static bool appendToSegment(std::vector<QueuedImage>& batch, size_t first, size_t count)
+{
+    struct iovec iov[MAX_WRITE_BATCH];
+    SegmentIndexEntry entries[MAX_WRITE_BATCH];
+    uint64_t offset = segment.dataSize;
+    for (size_t i = 0; i < count; ++i) {
+        const QueuedImage& image = batch[first + i];
+        iov[i] = {const_cast<unsigned char*>(image.data.data()), image.size};
+        entries[i] = {image.frameId, image.timestampNs, offset, static_cast<uint32_t>(image.size), 0};
+        offset += image.size;
+    }
+    size_t data_bytes = offset - segment.dataSize;
+    size_t index_bytes = count * sizeof(SegmentIndexEntry);
+
+    bool written = false;
+#ifdef HAVE_LIBURING
+    if (uring_ready) {
+        // One submission; the link keeps the index write behind the data
+        struct io_uring_sqe* data_sqe = io_uring_get_sqe(&writer_ring);
+        io_uring_prep_writev(data_sqe, segment.dataFd, iov, count, segment.dataSize);
+        io_uring_sqe_set_flags(data_sqe, IOSQE_IO_LINK);
+        io_uring_sqe_set_data64(data_sqe, 0);
+        struct io_uring_sqe* index_sqe = io_uring_get_sqe(&writer_ring);
+        io_uring_prep_write(index_sqe, segment.indexFd, entries, index_bytes, segment.indexSize);
+        io_uring_sqe_set_data64(index_sqe, 1);
+
+        int ret = io_uring_submit_and_wait(&writer_ring, 2);
+        if (ret < 0) {
+            std::fprintf(stderr, "io_uring submit failed: %s\n", strerror(-ret));
+        }
+        // Completions of a failed submission never arrive
+        bool complete = ret >= 0;
+        for (int reaped = 0; ret >= 0 && reaped < 2; ++reaped) {
+            struct io_uring_cqe* cqe;
+            if (io_uring_wait_cqe(&writer_ring, &cqe) != 0) {
+                complete = false;
+                break;
+            }
+            size_t expected = io_uring_cqe_get_data64(cqe) == 0 ? data_bytes : index_bytes;
+            complete = complete && cqe->res == static_cast<int>(expected);
+            io_uring_cqe_seen(&writer_ring, cqe);
+        }
+        written = complete;
+    }
+#endif
+
+    // Short or failed asynchronous writes are redone here; rewriting the
+    // same offsets is harmless
+    if (!written) {
+        struct iovec index_iov = {entries, index_bytes};
+        written = pwritevAll(segment.dataFd, iov, static_cast<int>(count), segment.dataSize)
+                  && pwritevAll(segment.indexFd, &index_iov, 1, segment.indexSize);
+    }
+    if (!written) {
+        std::fprintf(stderr, "Failed to append to segment %u: %s\n", segment.number, strerror(errno));
+        return false;
+    }
+    segment.dataSize += data_bytes;
+    segment.indexSize += index_bytes;
+    return true;
+}
+
+static void writeBatch(std::vector<QueuedImage>& batch, size_t count)
+{
+    size_t i = 0;
+    while (i < count) {
+        if (!segmentFor(batch[i].size)) {
+            images_failed.fetch_add(count - i, std::memory_order_relaxed);
+            break;
+        }
+        // As many images as still fit; an oversized one gets a segment to itself
+        size_t first = i;
+        uint64_t size = segment.dataSize;
+        while (i < count && (i == first || size + batch[i].size <= writer_config.segmentBytes)) {
+            size += batch[i].size;
+            i++;
+        }
+        bool ok = appendToSegment(batch, first, i - first);
+        (ok ? images_written : images_failed).fetch_add(i - first, std::memory_order_relaxed);
+        if (!ok) {
+            // Start over in a fresh segment rather than leave a hole
+            closeSegment();
+        }
+    }
+    batches_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void imageWriterThread()
+{
+    lowerWriterPriority();
+
+    // Buffers swapped out of the queue; their old contents go back in as
+    // recycled capacity
+    std::vector<QueuedImage> batch(writer_config.batchSize);
+    while (true) {
+        while (sem_wait(&writer_wakeup) != 0 && errno == EINTR) {
+        }
+
+        while (true) {
+            size_t count = 0;
+            {
+                std::lock_guard<PiMutex> lock(queue_mutex);
+                while (count < batch.size() && queue_count > 0) {
+                    QueuedImage& slot = queue_slots[queue_head];
+                    std::swap(batch[count].data, slot.data);
+                    batch[count].size = slot.size;
+                    batch[count].frameId = slot.frameId;
+                    batch[count].timestampNs = slot.timestampNs;
+                    queue_head = (queue_head + 1) % queue_slots.size();
+                    queue_count--;
+                    count++;
+                }
+            }
+            if (count == 0) {
+                break;
+            }
+            writeBatch(batch, count);
+        }
+
+        if (writer_stopping.load(std::memory_order_acquire)) {
+            return;
+        }
+    }
+}
+
+bool imageWriterInit(const ImageWriterConfig& config)
+{
+    writer_config = config;
+    writer_config.queueDepth = std::max<size_t>(writer_config.queueDepth, 1);
+    writer_config.batchSize = std::clamp<size_t>(writer_config.batchSize, 1,
+                                                 std::min(writer_config.queueDepth, MAX_WRITE_BATCH));
+
+    std::error_code ec;
+    std::filesystem::create_directories(writer_config.directory, ec);
+    if (ec) {
+        std::fprintf(stderr, "Failed to create %s: %s\n", writer_config.directory.c_str(), ec.message().c_str());
+        return false;
+    }
+
+    // Continue numbering after earlier recordings instead of overwriting them
+    next_segment = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(writer_config.directory, ec)) {
+        unsigned number;
+        if (sscanf(entry.path().filename().c_str(), "segment_%u.", &number) == 1) {
+            next_segment = std::max(next_segment, number + 1);
+        }
+    }
+
+#ifdef HAVE_LIBURING
+    int ret = io_uring_queue_init(URING_ENTRIES, &writer_ring, 0);
+    uring_ready = ret == 0;
+    if (!uring_ready) {
+        std::fprintf(stderr, "io_uring_queue_init failed: %s, using pwritev\n", strerror(-ret));
+    }
+#endif
+
+    queue_slots.assign(writer_config.queueDepth, QueuedImage{});
+    queue_head = 0;
+    queue_count = 0;
+    queue_high_water = 0;
+    sem_init(&writer_wakeup, 0, 0);
+    writer_stopping.store(false, std::memory_order_relaxed);
+    writer_thread = std::thread(imageWriterThread);
+    writer_initialized = true;
+    return true;
+}
+
+void imageWriterDeinit()
+{
+    if (!writer_initialized) {
+        return;
+    }
+    writer_stopping.store(true, std::memory_order_release);
+    sem_post(&writer_wakeup);
+    writer_thread.join();
+    closeSegment();
+    sem_destroy(&writer_wakeup);
+#ifdef HAVE_LIBURING
+    if (uring_ready) {
+        io_uring_queue_exit(&writer_ring);
+        uring_ready = false;
+    }
+#endif
+    queue_slots.clear();
+    writer_initialized = false;
+}
+
+bool imageWriterSubmit(std::vector<unsigned char>& data, size_t size, uint64_t frameId, uint64_t timestampNs)
+{
+    if (!writer_initialized || writer_stopping.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    bool dropped = false;
+    {
+        std::lock_guard<PiMutex> lock(queue_mutex);
+        if (queue_count == queue_slots.size()) {
+            // Storage is behind: the newest image is worth more than the oldest
+            queue_head = (queue_head + 1) % queue_slots.size();
+            queue_count--;
+            dropped = true;
+        }
+        QueuedImage& slot = queue_slots[(queue_head + queue_count) % queue_slots.size()];
+        std::swap(slot.data, data);
+        slot.size = size;
+        slot.frameId = frameId;
+        slot.timestampNs = timestampNs;
+        queue_count++;
+        queue_high_water = std::max(queue_high_water, queue_count);
+    }
+
+    images_submitted.fetch_add(1, std::memory_order_relaxed);
+    if (dropped) {
+        images_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    sem_post(&writer_wakeup);
+    return !dropped;
+}
+
+const char* imageWriterBackend()
+{
+#ifdef HAVE_LIBURING
+    if (uring_ready) {
+        return "io_uring";
+    }
+#endif
+    return "pwritev";
+}
+
+void logImageWriterStatistics()
+{
+    size_t high_water;
+    {
+        std::lock_guard<PiMutex> lock(queue_mutex);
+        high_water = queue_high_water;
+    }
+    std::printf("Image writer (%s): %llu submitted, %llu written in %llu batches, %llu dropped, %llu failed\n",
+                imageWriterBackend(),
+                static_cast<unsigned long long>(images_submitted.load(std::memory_order_relaxed)),
+                static_cast<unsigned long long>(images_written.load(std::memory_order_relaxed)),
+                static_cast<unsigned long long>(batches_written.load(std::memory_order_relaxed)),
+                static_cast<unsigned long long>(images_dropped.load(std::memory_order_relaxed)),
+                static_cast<unsigned long long>(images_failed.load(std::memory_order_relaxed)));
+    std::printf("  %llu segments in %s, queue high water %zu of %zu\n",
+                static_cast<unsigned long long>(segments_opened.load(std::memory_order_relaxed)),
+                writer_config.directory.c_str(), high_water, writer_config.queueDepth);
+}
+
+void collectImageWriterMetrics(MetricsWriter& out)
+{
+    out.counter("femc_image_writer_submitted_total", "Images handed to the writer",
+                images_submitted.load(std::memory_order_relaxed));
+    out.counter("femc_image_writer_written_total", "Images written to segment files",
+                images_written.load(std::memory_order_relaxed));
+    out.counter("femc_image_writer_dropped_total", "Queued images dropped because storage fell behind",
+                images_dropped.load(std::memory_order_relaxed));
+    out.counter("femc_image_writer_failed_total", "Images lost to write errors",
+                images_failed.load(std::memory_order_relaxed));
+    out.counter("femc_image_writer_batches_total", "Write submissions", batches_written.load(std::memory_order_relaxed));
+    out.counter("femc_image_writer_segments_total", "Segment files opened", segments_opened.load(std::memory_order_relaxed));
+}
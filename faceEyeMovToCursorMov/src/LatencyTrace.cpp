@@ -0,0 +1,114 @@
+#include "LatencyTrace.hpp"
+#include "TimeUtils.hpp"
+#include "Metrics.hpp"
+#include "ScheduleTrace.hpp"
+#include <atomic>
+#include <cstdio>
+
+static constexpr unsigned TRACE_RING_SIZE = 64; // Frames in flight we can follow
+static constexpr unsigned NUM_STAGES = static_cast<unsigned>(Stage::Count);
+
+static const char* const stage_names[NUM_STAGES] = {
+    "capture", "detection", "cursorTranslation", "cursorOutput", "compression"
+};
+static const uint16_t stage_tracks[NUM_STAGES] = {
+    scheduleTraceTrack(stage_names[0], TraceGroup::Frames), scheduleTraceTrack(stage_names[1], TraceGroup::Frames),
+    scheduleTraceTrack(stage_names[2], TraceGroup::Frames), scheduleTraceTrack(stage_names[3], TraceGroup::Frames),
+    scheduleTraceTrack(stage_names[4], TraceGroup::Frames)
+};
+static const char* const stage_labels[NUM_STAGES] = {
+    "stage=\"capture\"", "stage=\"detection\"", "stage=\"cursorTranslation\"", "stage=\"cursorOutput\"",
+    "stage=\"compression\""
+};
+
+// Per-frame stamps. Slots are reused by frame_id modulo the ring size, so a
+// stage only stamps a slot that still belongs to its frame.
+struct FrameTraceRecord {
+    std::atomic<uint64_t> frame_id{0};
+    std::atomic<uint64_t> capture_ns{0};
+    std::atomic<uint64_t> enter_ns[NUM_STAGES] = {};
+};
+
+static FrameTraceRecord trace_ring[TRACE_RING_SIZE];
+
+// Microsecond histograms: time spent inside each stage and frame age on stage exit
+static Histogram stage_duration[NUM_STAGES];
+static Histogram stage_age[NUM_STAGES];
+
+void latencyTraceBegin(uint64_t frame_id, uint64_t capture_ns)
+{
+    FrameTraceRecord& record = trace_ring[frame_id % TRACE_RING_SIZE];
+    record.frame_id.store(0, std::memory_order_relaxed);
+    record.capture_ns.store(capture_ns, std::memory_order_relaxed);
+    for (unsigned i = 0; i < NUM_STAGES; ++i) {
+        record.enter_ns[i].store(0, std::memory_order_relaxed);
+    }
+    record.frame_id.store(frame_id, std::memory_order_release);
+}
+
+void latencyTraceEnter(uint64_t frame_id, Stage stage)
+{
+    FrameTraceRecord& record = trace_ring[frame_id % TRACE_RING_SIZE];
+    if (record.frame_id.load(std::memory_order_acquire) == frame_id) {
+        record.enter_ns[static_cast<unsigned>(stage)].store(monotonicNowNs(), std::memory_order_relaxed);
+    }
+}
+
+void latencyTraceExit(uint64_t frame_id, uint64_t capture_ns, Stage stage)
+{
+    unsigned s = static_cast<unsigned>(stage);
+    uint64_t now = monotonicNowNs();
+
+    if (now > capture_ns) {
+        stage_age[s].record((now - capture_ns) / 1000);
+    }
+
+    FrameTraceRecord& record = trace_ring[frame_id % TRACE_RING_SIZE];
+    if (record.frame_id.load(std::memory_order_acquire) != frame_id) {
+        return; // Slot already reused by a newer frame
+    }
+    uint64_t enter = record.enter_ns[s].load(std::memory_order_relaxed);
+    if (enter != 0 && now >= enter) {
+        stage_duration[s].record((now - enter) / 1000);
+        traceSpan(TraceKind::Stage, stage_tracks[s], enter, now, frame_id);
+    }
+}
+
+const Histogram& latencyTraceEndToEnd()
+{
+    return stage_age[static_cast<unsigned>(Stage::CursorOutput)];
+}
+
+void latencyTraceReport()
+{
+    const Histogram& e2e = latencyTraceEndToEnd();
+    std::printf("Capture-to-cursor latency (%llu frames): p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+                static_cast<unsigned long long>(e2e.count()),
+                e2e.percentile(50) / 1000.0, e2e.percentile(99) / 1000.0, e2e.max() / 1000.0);
+
+    for (unsigned s = 0; s < NUM_STAGES; ++s) {
+        if (stage_age[s].count() == 0) {
+            continue;
+        }
+        std::printf("  %-18s in-stage p50 %.2f p99 %.2f max %.2f ms | age at exit p50 %.2f p99 %.2f max %.2f ms\n",
+                    stage_names[s],
+                    stage_duration[s].percentile(50) / 1000.0, stage_duration[s].percentile(99) / 1000.0,
+                    stage_duration[s].max() / 1000.0,
+                    stage_age[s].percentile(50) / 1000.0, stage_age[s].percentile(99) / 1000.0,
+                    stage_age[s].max() / 1000.0);
+    }
+}
+
+void collectLatencyTraceMetrics(MetricsWriter& out)
+{
+    out.summary("femc_capture_to_cursor_seconds", "Age of a frame when the cursor first moved towards it",
+                latencyTraceEndToEnd(), 1e-6);
+    for (unsigned s = 0; s < NUM_STAGES; ++s) {
+        out.summary("femc_stage_duration_seconds", "Time a frame spent inside a pipeline stage",
+                    stage_duration[s], 1e-6, stage_labels[s]);
+    }
+    for (unsigned s = 0; s < NUM_STAGES; ++s) {
+        out.summary("femc_stage_exit_age_seconds", "Age of a frame when it left a pipeline stage",
+                    stage_age[s], 1e-6, stage_labels[s]);
+    }
+}
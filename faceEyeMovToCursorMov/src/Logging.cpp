@@ -1,69 +1,179 @@
 #include "Logging.hpp"
-#include <fstream>
-#include <sstream>
-#include <iomanip>
+#include "SpscRing.hpp"
+#include "TimeUtils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/resource.h>
 
-// Mutex for CSV file access
-static std::mutex csv_mutex;
+static constexpr int MAX_LOG_RINGS = 32;        // Threads that may log over the program's life
+static constexpr size_t LOG_RING_SIZE = 1024;   // Records per thread between drains
+static constexpr uint32_t DRAIN_INTERVAL_MS = 100;
+static constexpr int LOG_WRITER_NICE = 19;
 
-// Static variables for CSV file and filename
-static std::ofstream csv_file;
-static std::string csv_filename;
-static bool initialized = false;
+struct LogRing {
+    SpscRing<LogRecord, LOG_RING_SIZE> records;
+    std::atomic<uint64_t> dropped{0};
+    uint32_t sequence = 0; // Only touched by the owning thread
+};
 
-void initLoggingService()
+// A thread claims a ring the first time it logs and keeps it
+static LogRing log_rings[MAX_LOG_RINGS];
+static std::atomic<int> rings_claimed{0};
+static thread_local int thread_ring = -1;
+static std::atomic<uint64_t> unringed_dropped{0}; // Threads beyond MAX_LOG_RINGS
+
+static std::string log_filename;
+static int log_fd = -1;
+static std::thread log_writer;
+static sem_t log_writer_wakeup;
+static std::atomic<bool> log_writer_stopping{false};
+static std::vector<LogRecord> drain_buffer;
+static uint64_t records_written = 0;
+static uint64_t write_failures = 0;
+
+static LogRing* threadRing()
+{
+    if (thread_ring < 0) {
+        thread_ring = rings_claimed.fetch_add(1, std::memory_order_relaxed);
+    }
+    return thread_ring < MAX_LOG_RINGS ? &log_rings[thread_ring] : nullptr;
+}
+
+void logEvent(LogEvent event, int64_t v0, int64_t v1, int64_t v2, int64_t v3, int64_t v4, int64_t v5)
+{
+    LogRing* ring = threadRing();
+    if (ring == nullptr) {
+        unringed_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    LogRecord record = {monotonicNowNs(), static_cast<uint16_t>(event), static_cast<uint16_t>(thread_ring),
+                        ring->sequence++, {v0, v1, v2, v3, v4, v5}};
+    if (!ring->records.push(record)) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Everything queued on all rings, in time order, in one write
+static void drainRings()
 {
-    struct timespec now;
-    clock_gettime(CLOCK_REALTIME, &now);  // Use CLOCK_REALTIME for correct date/time
-    std::time_t sec = now.tv_sec;
-    std::stringstream filename;
-    filename << "data_" << std::put_time(std::localtime(&sec), "%Y-%m-%dT%H-%M-%S") << ".csv";
-    csv_filename = filename.str();
-
-    {
-        std::lock_guard<std::mutex> lock(csv_mutex);
-        csv_file.open(csv_filename, std::ios::app);
-        if (!csv_file.is_open()) {
-            std::string error_message = "Failed to open CSV file: " + csv_filename;
-            std::puts(error_message.c_str());
+    drain_buffer.clear();
+    int rings = std::min(rings_claimed.load(std::memory_order_relaxed), MAX_LOG_RINGS);
+    LogRecord record;
+    for (int i = 0; i < rings; ++i) {
+        while (log_rings[i].records.pop(record)) {
+            drain_buffer.push_back(record);
+        }
+    }
+    if (drain_buffer.empty()) {
+        return;
+    }
+    std::sort(drain_buffer.begin(), drain_buffer.end(),
+              [](const LogRecord& a, const LogRecord& b) { return a.timestampNs < b.timestampNs; });
+
+    const char* data = reinterpret_cast<const char*>(drain_buffer.data());
+    size_t remaining = drain_buffer.size() * sizeof(LogRecord);
+    while (remaining > 0) {
+        ssize_t n = write(log_fd, data, remaining);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            write_failures++;
             return;
         }
-        csv_file << "timestamp,data\n";
+        data += n;
+        remaining -= n;
     }
-    initialized = true;
+    records_written += drain_buffer.size();
 }
 
-void messageQueueToCsvService() {
-    // Initialize CSV file with timestamp in filename if not already done
-    if (!initialized) {
-        initLoggingService();
+static void logWriterThread()
+{
+    // Draining is bookkeeping: it only ever runs when no service wants the CPU
+    if (setpriority(PRIO_PROCESS, 0, LOG_WRITER_NICE) != 0) {
+        perror("setpriority(log writer) failed");
+    }
+
+    while (!log_writer_stopping.load(std::memory_order_acquire)) {
+        struct timespec wake = nsToTimespec(monotonicNowNs() + DRAIN_INTERVAL_MS * 1'000'000ULL);
+        sem_clockwait(&log_writer_wakeup, CLOCK_MONOTONIC, &wake);
+        drainRings();
+    }
+    drainRings();
+}
+
+bool initLoggingService(const std::string& path)
+{
+    log_filename = path;
+    if (log_filename.empty()) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);  // Use CLOCK_REALTIME for correct date/time
+        std::time_t sec = now.tv_sec;
+        char name[64];
+        std::strftime(name, sizeof(name), "data_%Y-%m-%dT%H-%M-%S.bin", std::localtime(&sec));
+        log_filename = name;
     }
 
-    // Get current timestamp for record
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);  // Use CLOCK_MONOTONIC for high-resolution timestamp
-    std::stringstream timestamp;
-    timestamp << now.tv_sec << "." << std::setw(9) << std::setfill('0') << now.tv_nsec;
-
-    // Check for data from ZeroMQ control socket
-    std::string data;
-    zmq::message_t message;
-    if (zmq_pull_control_socket.recv(message, zmq::recv_flags::dontwait)) {  // Non-blocking
-        data = std::string(static_cast<char*>(message.data()), message.size());
+    log_fd = open(log_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (log_fd < 0) {
+        std::fprintf(stderr, "Failed to open log file %s: %s\n", log_filename.c_str(), strerror(errno));
+        return false;
     }
 
-    // Append to CSV if data was found
-    if (!data.empty() && csv_file.is_open()) {
-        std::lock_guard<std::mutex> lock(csv_mutex);
-        csv_file << timestamp.str() << "," << data << "\n";
+    LogFileHeader header = {};
+    memcpy(header.magic, LOG_FILE_MAGIC, sizeof(header.magic));
+    header.version = LOG_FILE_VERSION;
+    header.recordSize = sizeof(LogRecord);
+    struct timespec realtime;
+    header.monotonicStartNs = monotonicNowNs();
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    header.realtimeStartNs = timespecToNs(realtime);
+    if (write(log_fd, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header))) {
+        std::fprintf(stderr, "Failed to write log header to %s\n", log_filename.c_str());
+        close(log_fd);
+        log_fd = -1;
+        return false;
     }
+
+    drain_buffer.reserve(MAX_LOG_RINGS * LOG_RING_SIZE);
+    sem_init(&log_writer_wakeup, 0, 0);
+    log_writer_stopping.store(false, std::memory_order_relaxed);
+    log_writer = std::thread(logWriterThread);
+    return true;
 }
 
-void flushCsvFile() {
-    std::lock_guard<std::mutex> lock(csv_mutex);
-    if (csv_file.is_open()) {
-        csv_file.flush();
-        csv_file.close();
+void deinitLoggingService()
+{
+    if (log_fd < 0) {
+        return;
+    }
+    log_writer_stopping.store(true, std::memory_order_release);
+    sem_post(&log_writer_wakeup);
+    log_writer.join();
+    sem_destroy(&log_writer_wakeup);
+    close(log_fd);
+    log_fd = -1;
+
+    uint64_t dropped = unringed_dropped.load(std::memory_order_relaxed);
+    int rings = std::min(rings_claimed.load(std::memory_order_relaxed), MAX_LOG_RINGS);
+    for (int i = 0; i < rings; ++i) {
+        dropped += log_rings[i].dropped.load(std::memory_order_relaxed);
     }
-}
\ No newline at end of file
+    std::printf("Log %s: %llu records from %d threads, %llu dropped, %llu failed writes\n",
+                log_filename.c_str(), static_cast<unsigned long long>(records_written), rings,
+                static_cast<unsigned long long>(dropped), static_cast<unsigned long long>(write_failures));
+}
+
+std::string getLogFileName()
+{
+    return log_filename;
+}
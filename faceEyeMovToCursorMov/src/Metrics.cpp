@@ -0,0 +1,229 @@
+#include "Metrics.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static constexpr int METRICS_SERVER_NICE = 19;
+static constexpr int ACCEPT_POLL_MS = 200;   // How quickly the server notices it is being stopped
+static constexpr int REQUEST_WAIT_MS = 50;   // Grace for a client to send its request line
+static constexpr int SEND_TIMEOUT_S = 1;     // A client that stops reading is dropped
+static constexpr double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+static std::vector<MetricsCollector> collectors;
+static std::string socket_path;
+static int listen_fd = -1;
+static std::thread metrics_server;
+static std::atomic<bool> metrics_server_stopping{false};
+static std::string scrape_buffer; // Only touched by the server thread
+static uint64_t scrapes = 0;
+
+static void appendNumber(std::string& out, double value)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.15g", value);
+    out += text;
+}
+
+void MetricsWriter::_header(const char* name, const char* help, const char* type)
+{
+    if (_lastName == name) {
+        return;
+    }
+    _lastName = name;
+    _out += "# HELP ";
+    _out += name;
+    _out += ' ';
+    _out += help;
+    _out += "\n# TYPE ";
+    _out += name;
+    _out += ' ';
+    _out += type;
+    _out += '\n';
+}
+
+void MetricsWriter::_sample(const char* name, const char* suffix, const char* labels, const char* extraLabel,
+                            double value)
+{
+    _out += name;
+    _out += suffix;
+    bool has_labels = labels != nullptr && labels[0] != '\0';
+    if (has_labels || extraLabel != nullptr) {
+        _out += '{';
+        if (has_labels) {
+            _out += labels;
+        }
+        if (extraLabel != nullptr) {
+            if (has_labels) {
+                _out += ',';
+            }
+            _out += extraLabel;
+        }
+        _out += '}';
+    }
+    _out += ' ';
+    appendNumber(_out, value);
+    _out += '\n';
+}
+
+void MetricsWriter::counter(const char* name, const char* help, double value, const char* labels)
+{
+    _header(name, help, "counter");
+    _sample(name, "", labels, nullptr, value);
+}
+
+void MetricsWriter::gauge(const char* name, const char* help, double value, const char* labels)
+{
+    _header(name, help, "gauge");
+    _sample(name, "", labels, nullptr, value);
+}
+
+void MetricsWriter::summary(const char* name, const char* help, const Histogram& histogram, double scale,
+                            const char* labels)
+{
+    _header(name, help, "summary");
+    uint64_t count = histogram.count();
+    for (double q : QUANTILES) {
+        char quantile[32];
+        std::snprintf(quantile, sizeof(quantile), "quantile=\"%g\"", q);
+        _sample(name, "", labels, quantile, histogram.percentile(q * 100.0) * scale);
+    }
+    _sample(name, "_sum", labels, nullptr, histogram.mean() * count * scale);
+    _sample(name, "_count", labels, nullptr, static_cast<double>(count));
+}
+
+void metricsRegister(MetricsCollector collector)
+{
+    collectors.push_back(std::move(collector));
+}
+
+void metricsRender(std::string& out)
+{
+    out.clear();
+    MetricsWriter writer(out);
+    writer.counter("femc_metrics_scrapes_total", "Scrapes served on the metrics socket", static_cast<double>(++scrapes));
+    for (const MetricsCollector& collector : collectors) {
+        collector(writer);
+    }
+}
+
+static bool sendAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static void serveClient(int client)
+{
+    // Take whatever the client sent first; curl sends an HTTP request,
+    // socat and friends usually nothing
+    char request[512];
+    ssize_t received = 0;
+    struct pollfd pfd = {client, POLLIN, 0};
+    if (poll(&pfd, 1, REQUEST_WAIT_MS) > 0) {
+        received = recv(client, request, sizeof(request) - 1, MSG_DONTWAIT);
+    }
+    bool http = received >= 4 && (std::memcmp(request, "GET ", 4) == 0 || std::memcmp(request, "HEAD", 4) == 0);
+    bool head = http && std::memcmp(request, "HEAD", 4) == 0;
+
+    struct timeval timeout = {SEND_TIMEOUT_S, 0};
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    metricsRender(scrape_buffer);
+    if (http) {
+        char header[160];
+        int length = std::snprintf(header, sizeof(header),
+                                   "HTTP/1.0 200 OK\r\n"
+                                   "Content-Type: text/plain; version=0.0.4\r\n"
+                                   "Content-Length: %zu\r\n"
+                                   "Connection: close\r\n\r\n",
+                                   scrape_buffer.size());
+        if (!sendAll(client, header, length) || head) {
+            return;
+        }
+    }
+    sendAll(client, scrape_buffer.data(), scrape_buffer.size());
+}
+
+static void metricsServerThread()
+{
+    // Scrapes are bookkeeping: they only ever run when no service wants the CPU
+    if (setpriority(PRIO_PROCESS, 0, METRICS_SERVER_NICE) != 0) {
+        perror("setpriority(metrics server) failed");
+    }
+
+    while (!metrics_server_stopping.load(std::memory_order_acquire)) {
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, ACCEPT_POLL_MS) <= 0) {
+            continue;
+        }
+        int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        serveClient(client);
+        close(client);
+    }
+}
+
+bool metricsInit(const std::string& path)
+{
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        std::fprintf(stderr, "Invalid metrics socket path: %s\n", path.c_str());
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("metrics socket failed");
+        return false;
+    }
+    unlink(path.c_str()); // Left behind by a run that did not shut down cleanly
+    if (bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listen_fd, 4) != 0) {
+        std::fprintf(stderr, "Failed to listen on metrics socket %s: %s\n", path.c_str(), strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+
+    socket_path = path;
+    scrape_buffer.reserve(64 * 1024);
+    metrics_server_stopping.store(false, std::memory_order_relaxed);
+    metrics_server = std::thread(metricsServerThread);
+    return true;
+}
+
+void metricsDeinit()
+{
+    if (listen_fd < 0) {
+        return;
+    }
+    metrics_server_stopping.store(true, std::memory_order_release);
+    metrics_server.join();
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path.c_str());
+    std::printf("Metrics: %llu scrapes served on %s\n", static_cast<unsigned long long>(scrapes),
+                socket_path.c_str());
+}
@@ -0,0 +1,654 @@
+#include "PixelKernels.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_KERNELS_X86 1
+#elif defined(__ARM_NEON) && defined(PIXEL_KERNELS_ENABLE_NEON)
+// Opt-in (make NEON=1) until `make check-neon test-neon` has passed on real
+// ARMv7 and AArch64 toolchains; plain ARM builds use the scalar kernels
+#include <arm_neon.h>
+#define PIXEL_KERNELS_NEON 1
+#endif
+
+// BT.601 limited range YUV -> RGB in 13-bit fixed point, small enough for
+// 16-bit SIMD multiplies: c = (y*CY + u*Cu + v*Cv + YUV_ROUND) >> YUV_SHIFT
+static constexpr int YUV_SHIFT = 13;
+static constexpr int YUV_ROUND = 1 << (YUV_SHIFT - 1);
+static constexpr int16_t CY = 9535;   // 1.164
+static constexpr int16_t CVR = 13074; // 1.596
+static constexpr int16_t CVG = -6660; // -0.813
+static constexpr int16_t CUG = -3203; // -0.391
+static constexpr int16_t CUB = 16531; // 2.018
+
+// One implementation of the per-row kernels the frame functions are built on
+struct KernelTable {
+    const char* name;
+    void (*yRow)(const uint8_t* src, uint8_t* dst, int width);
+    void (*yDecimate2Row)(const uint8_t* src, size_t stride, uint8_t* dst, int dstWidth);
+    void (*yDecimate4Row)(const uint8_t* src, size_t stride, uint8_t* dst, int dstWidth);
+    void (*chromaRow)(const uint8_t* src, size_t stride, uint8_t* u, uint8_t* v, int width);
+    void (*bgrRow)(const uint8_t* src, uint8_t* dst, int width);
+    void (*sadRow)(const uint8_t* a, const uint8_t* b, uint32_t* sums, int blocks);
+};
+
+// ---------------------------------------------------------------------------
+// Scalar reference, also used for the columns left over by the SIMD loops
+
+static void yRowScalar(const uint8_t* src, uint8_t* dst, int width)
+{
+    for (int x = 0; x < width; ++x) {
+        dst[x] = src[2 * x];
+    }
+}
+
+static void yDecimate2RowScalar(const uint8_t* src, size_t stride, uint8_t* dst, int dstWidth)
+{
+    const uint8_t* row0 = src;
+    const uint8_t* row1 = src + stride;
+    for (int x = 0; x < dstWidth; ++x) {
+        dst[x] = static_cast<uint8_t>((row0[4 * x] + row0[4 * x + 2] + row1[4 * x] + row1[4 * x + 2] + 2) >> 2);
+    }
+}
+
+static void yDecimate4RowScalar(const uint8_t* src, size_t stride, uint8_t* dst, int dstWidth)
+{
+    for (int x = 0; x < dstWidth; ++x) {
+        int sum = 0;
+        for (int row = 0; row < 4; ++row) {
+            const uint8_t* p = src + row * stride + 8 * x;
+            sum += p[0] + p[2] + p[4] + p[6];
+        }
+        dst[x] = static_cast<uint8_t>((sum + 8) >> 4);
+    }
+}
+
+// width is in pixels; writes width/2 samples to each of u and v
+static void chromaRowScalar(const uint8_t* src, size_t stride, uint8_t* u, uint8_t* v, int width)
+{
+    const uint8_t* row0 = src;
+    const uint8_t* row1 = src + stride;
+    for (int x = 0; x < width / 2; ++x) {
+        u[x] = static_cast<uint8_t>((row0[4 * x + 1] + row1[4 * x + 1] + 1) >> 1);
+        v[x] = static_cast<uint8_t>((row0[4 * x + 3] + row1[4 * x + 3] + 1) >> 1);
+    }
+}
+
+static inline uint8_t clampPixel(int value)
+{
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static void bgrRowScalar(const uint8_t* src, uint8_t* dst, int width)
+{
+    for (int x = 0; x < width / 2; ++x) {
+        int u = src[4 * x + 1] - 128;
+        int v = src[4 * x + 3] - 128;
+        for (int i = 0; i < 2; ++i) {
+            int y = src[4 * x + 2 * i] - 16;
+            uint8_t* out = dst + 3 * (2 * x + i);
+            out[0] = clampPixel((y * CY + u * CUB + YUV_ROUND) >> YUV_SHIFT);
+            out[1] = clampPixel((y * CY + u * CUG + v * CVG + YUV_ROUND) >> YUV_SHIFT);
+            out[2] = clampPixel((y * CY + v * CVR + YUV_ROUND) >> YUV_SHIFT);
+        }
+    }
+}
+
+// Adds sum |a - b| over each group of 8 pixels to sums[group]
+static void sadRowScalar(const uint8_t* a, const uint8_t* b, uint32_t* sums, int blocks)
+{
+    for (int i = 0; i < blocks; ++i) {
+        uint32_t sum = 0;
+        for (int x = 0; x < 8; ++x) {
+            sum += std::abs(a[8 * i + x] - b[8 * i + x]);
+        }
+        sums[i] += sum;
+    }
+}
+
+static constexpr KernelTable SCALAR_KERNELS = {
+    "scalar", yRowScalar, yDecimate2RowScalar, yDecimate4RowScalar, chromaRowScalar, bgrRowScalar, sadRowScalar
+};
+
+#ifdef PIXEL_KERNELS_X86
+// ---------------------------------------------------------------------------
+// SSE2 / SSSE3 / AVX2
+
+__attribute__((target("sse2")))
+static void yRowSse2(const uint8_t* src, uint8_t* dst, int width)
+{
+    const __m128i lumaMask = _mm_set1_epi16(0x00FF);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * x)), lumaMask);
+        __m128i b = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * x + 16)), lumaMask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(a, b));
+    }
+    yRowScalar(src + 2 * x, dst + x, width - x);
+}
+
+__attribute__((target("sse2")))
+static void yDecimate2RowSse2(const uint8_t* src, size_t stride, uint8_t* dst, int dstWidth)
+{
+    const __m128i lumaMask = _mm_set1_epi16(0x00FF);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi16(2);
+    int x = 0;
+    for (; x + 8 <= dstWidth; x += 8) {
+        const uint8_t* p0 = src + 4 * x;
+        const uint8_t* p1 = p0 + stride;
+        // Column sums of the two rows, then pairs of columns
+        __m128i a = _mm_add_epi16(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p0)), lumaMask),
+                                  _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p1)), lumaMask));
+        __m128i b = _mm_add_epi16(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p0 + 16)), lumaMask),
+                                  _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p1 + 16)), lumaMask));
+        __m128i sums = _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+        sums = _mm_srli_epi16(_mm_add_epi16(sums, round), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sums, sums));
+    }
+    yDecimate2RowScalar(src + 4 * x, stride, dst + x, dstWidth - x);
+}
+
+__attribute__((target("sse2")))
+static void yDecimate4RowSse2(const uint8_t* src, size_t stride, uint8_t* dst, int dstWidth)
+{
+    const __m128i lumaMask = _mm_set1_epi16(0x00FF);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi32(8);
+    int x = 0;
+    for (; x + 4 <= dstWidth; x += 4) {
+        __m128i a = _mm_setzero_si128();
+        __m128i b = _mm_setzero_si128();
+        for (int row = 0; row < 4; ++row) {
+            const uint8_t* p = src + row * stride + 8 * x;
+            a = _mm_add_epi16(a, _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), lumaMask));
+            b = _mm_add_epi16(b, _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), lumaMask));
+        }
+        __m128i pairs = _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+        __m128i quads = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(pairs, ones), round), 4);
+        quads = _mm_packs_epi32(quads, quads);
+        int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(quads, quads));
+        std::memcpy(dst + x, &packed, sizeof(packed));
+    }
+    yDecimate4RowScalar(src + 8 * x, stride, dst + x, dstWidth - x);
+}
+
+__attribute__((target("sse2")))
+static void chromaRowSse2(const uint8_t* src, size_t stride, uint8_t* u, uint8_t* v, int width)
+{
+    const __m128i lowByte = _mm_set1_epi16(0x00FF);
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0; // Chroma sample index, two pixels each
+    for (; 2 * x + 16 <= width; x += 8) {
+        const uint8_t* p0 = src + 4 * x;
+        const uint8_t* p1 = p0 + stride;
+        // avg_epu8 rounds up like the scalar (a + b + 1) >> 1
+        __m128i a = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p0)),
+                                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1)));
+        __m128i b = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p0 + 16)),
+                                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1 + 16)));
+        __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x), _mm_packus_epi16(_mm_and_si128(uv, lowByte), zero));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x), _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+    }
+    chromaRowScalar(src + 4 * x, stride, u + x, v + x, width - 2 * x);
+}
+
+// One colour channel of 8 pixels: (y*CY + c1*k1 + c2*k2 + YUV_ROUND) >> YUV_SHIFT as int16
+__attribute__((target("sse2")))
+static inline __m128i yuvChannelSse2(__m128i y, __m128i c1, int16_t k1, __m128i c2, int16_t k2)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i coeffA = _mm_set1_epi32(static_cast<uint16_t>(CY) | (static_cast<uint32_t>(static_cast<uint16_t>(k1)) << 16));
+    const __m128i coeffB = _mm_set1_epi32(static_cast<uint16_t>(k2) | (static_cast<uint32_t>(YUV_ROUND) << 16));
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(y, c1), coeffA),
+                               _mm_madd_epi16(_mm_unpacklo_epi16(c2, one), coeffB));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(y, c1), coeffA),
+                               _mm_madd_epi16(_mm_unpackhi_epi16(c2, one), coeffB));
+    return _mm_packs_epi32(_mm_srai_epi32(lo, YUV_SHIFT), _mm_srai_epi32(hi, YUV_SHIFT));
+}
+
+// B, G and R of the 8 pixels in 16 bytes of YUYV, as int16
+__attribute__((target("sse2")))
+static inline void yuyvToBgr8Sse2(__m128i in, __m128i& b, __m128i& g, __m128i& r)
+{
+    const __m128i lowWord = _mm_set1_epi32(0xFFFF);
+    __m128i y = _mm_sub_epi16(_mm_and_si128(in, _mm_set1_epi16(0x00FF)), _mm_set1_epi16(16));
+    // Each 32-bit lane holds U (low half) and V (high half) of one pixel pair;
+    // copy them to both halves so every pixel sees its own chroma
+    __m128i uv = _mm_srli_epi16(in, 8);
+    __m128i u = _mm_and_si128(uv, lowWord);
+    u = _mm_sub_epi16(_mm_or_si128(u, _mm_slli_epi32(u, 16)), _mm_set1_epi16(128));
+    __m128i v = _mm_srli_epi32(uv, 16);
+    v = _mm_sub_epi16(_mm_or_si128(v, _mm_slli_epi32(v, 16)), _mm_set1_epi16(128));
+
+    b = yuvChannelSse2(y, u, CUB, v, 0);
+    g = yuvChannelSse2(y, u, CUG, v, CVG);
+    r = yuvChannelSse2(y, v, CVR, u, 0);
+}
+
+// pshufb masks that interleave three 16-byte planes into packed triplets:
+// mask[block][plane] picks the bytes of that plane landing in output block
+// `block`, -128 zeroes the others
+struct BgrShuffle {
+    alignas(16) int8_t mask[3][3][16];
+};
+
+static constexpr BgrShuffle makeBgrShuffle()
+{
+    BgrShuffle shuffle{};
+    for (int block = 0; block < 3; ++block) {
+        for (int plane = 0; plane < 3; ++plane) {
+            for (int i = 0; i < 16; ++i) {
+                int n = 16 * block + i;
+                shuffle.mask[block][plane][i] = static_cast<int8_t>(n % 3 == plane ? n / 3 : -128);
+            }
+        }
+    }
+    return shuffle;
+}
+
+static constexpr BgrShuffle BGR_SHUFFLE = makeBgrShuffle();
+
+__attribute__((target("ssse3")))
+static void bgrRowSsse3(const uint8_t* src, uint8_t* dst, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i b0, g0, r0, b1, g1, r1;
+        yuyvToBgr8Sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * x)), b0, g0, r0);
+        yuyvToBgr8Sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * x + 16)), b1, g1, r1);
+        __m128i planes[3] = {_mm_packus_epi16(b0, b1), _mm_packus_epi16(g0, g1), _mm_packus_epi16(r0, r1)};
+
+        for (int block = 0; block < 3; ++block) {
+            __m128i out = _mm_setzero_si128();
+            for (int plane = 0; plane < 3; ++plane) {
+                __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(BGR_SHUFFLE.mask[block][plane]));
+                out = _mm_or_si128(out, _mm_shuffle_epi8(planes[plane], mask));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * x + 16 * block), out);
+        }
+    }
+    bgrRowScalar(src + 2 * x, dst + 3 * x, width - x);
+}
+
+__attribute__((target("avx2")))
+static void yRowAvx2(const uint8_t* src, uint8_t* dst, int width)
+{
+    const __m256i lumaMask = _mm256_set1_epi16(0x00FF);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i a = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * x)), lumaMask);
+        __m256i b = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * x + 32)), lumaMask);
+        // packus works per 128-bit lane; restore pixel order afterwards
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), packed);
+    }
+    yRowSse2(src + 2 * x, dst + x, width - x);
+}
+
+__attribute__((target("avx2")))
+static void yDecimate2RowAvx2(const uint8_t* src, size_t stride, uint8_t* dst, int dstWidth)
+{
+    const __m256i lumaMask = _mm256_set1_epi16(0x00FF);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i round = _mm256_set1_epi16(2);
+    int x = 0;
+    for (; x + 16 <= dstWidth; x += 16) {
+        const uint8_t* p0 = src + 4 * x;
+        const uint8_t* p1 = p0 + stride;
+        __m256i a = _mm256_add_epi16(_mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p0)), lumaMask),
+                                     _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p1)), lumaMask));
+        __m256i b = _mm256_add_epi16(_mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p0 + 32)), lumaMask),
+                                     _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p1 + 32)), lumaMask));
+        __m256i sums = _mm256_packs_epi32(_mm256_madd_epi16(a, ones), _mm256_madd_epi16(b, ones));
+        sums = _mm256_permute4x64_epi64(sums, 0xD8);
+        sums = _mm256_srli_epi16(_mm256_add_epi16(sums, round), 2);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums, sums), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm256_castsi256_si128(packed));
+    }
+    yDecimate2RowSse2(src + 4 * x, stride, dst + x, dstWidth - x);
+}
+
+// psadbw sums each 8-byte half separately, i.e. two blocks per instruction
+__attribute__((target("sse2")))
+static void sadRowSse2(const uint8_t* a, const uint8_t* b, uint32_t* sums, int blocks)
+{
+    int i = 0;
+    for (; i + 2 <= blocks; i += 2) {
+        __m128i sad = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 8 * i)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 8 * i)));
+        sums[i] += static_cast<uint32_t>(_mm_cvtsi128_si32(sad));
+        sums[i + 1] += static_cast<uint32_t>(_mm_extract_epi16(sad, 4));
+    }
+    sadRowScalar(a + 8 * i, b + 8 * i, sums + i, blocks - i);
+}
+
+// SSE2 is part of x86-64, SSSE3 only matters for the BGR interleave
+static constexpr KernelTable SSE2_KERNELS = {
+    "sse2", yRowSse2, yDecimate2RowSse2, yDecimate4RowSse2, chromaRowSse2, bgrRowScalar, sadRowSse2
+};
+static constexpr KernelTable SSSE3_KERNELS = {
+    "ssse3", yRowSse2, yDecimate2RowSse2, yDecimate4RowSse2, chromaRowSse2, bgrRowSsse3, sadRowSse2
+};
+// The 4x decimation, chroma and SAD rows are load bound and gain nothing from 256-bit registers
+static constexpr KernelTable AVX2_KERNELS = {
+    "avx2", yRowAvx2, yDecimate2RowAvx2, yDecimate4RowSse2, chromaRowSse2, bgrRowSsse3, sadRowSse2
+};
+#endif // PIXEL_KERNELS_X86
+
+#ifdef PIXEL_KERNELS_NEON
+// ---------------------------------------------------------------------------
+// NEON (ARMv7 and AArch64)
+
+static void yRowNeon(const uint8_t* src, uint8_t* dst, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t yuyv = vld2q_u8(src + 2 * x); // val[0] = Y, val[1] = U/V
+        vst1q_u8(dst + x, yuyv.val[0]);
+    }
+    yRowScalar(src + 2 * x, dst + x, width - x);
+}
+
+static void yDecimate2RowNeon(const uint8_t* src, size_t stride, uint8_t* dst, int dstWidth)
+{
+    int x = 0;
+    for (; x + 16 <= dstWidth; x += 16) {
+        uint8x16x4_t r0 = vld4q_u8(src + 4 * x);          // Y0 U Y1 V of 16 pixel pairs
+        uint8x16x4_t r1 = vld4q_u8(src + stride + 4 * x);
+        uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(r0.val[0]), vget_low_u8(r0.val[2])),
+                                  vaddl_u8(vget_low_u8(r1.val[0]), vget_low_u8(r1.val[2])));
+        uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(r0.val[0]), vget_high_u8(r0.val[2])),
+                                  vaddl_u8(vget_high_u8(r1.val[0]), vget_high_u8(r1.val[2])));
+        vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+    }
+    yDecimate2RowScalar(src + 4 * x, stride, dst + x, dstWidth - x);
+}
+
+static void yDecimate4RowNeon(const uint8_t* src, size_t stride, uint8_t* dst, int dstWidth)
+{
+    int x = 0;
+    for (; x + 8 <= dstWidth; x += 8) {
+        uint16x8_t lo = vdupq_n_u16(0); // Pair sums of pairs 0-7
+        uint16x8_t hi = vdupq_n_u16(0); // and 8-15
+        for (int row = 0; row < 4; ++row) {
+            uint8x16x4_t r = vld4q_u8(src + row * stride + 8 * x);
+            lo = vaddq_u16(lo, vaddl_u8(vget_low_u8(r.val[0]), vget_low_u8(r.val[2])));
+            hi = vaddq_u16(hi, vaddl_u8(vget_high_u8(r.val[0]), vget_high_u8(r.val[2])));
+        }
+        uint16x8_t quads = vcombine_u16(vpadd_u16(vget_low_u16(lo), vget_high_u16(lo)),
+                                        vpadd_u16(vget_low_u16(hi), vget_high_u16(hi)));
+        vst1_u8(dst + x, vrshrn_n_u16(quads, 4));
+    }
+    yDecimate4RowScalar(src + 8 * x, stride, dst + x, dstWidth - x);
+}
+
+static void chromaRowNeon(const uint8_t* src, size_t stride, uint8_t* u, uint8_t* v, int width)
+{
+    int x = 0; // Chroma sample index, two pixels each
+    for (; 2 * x + 32 <= width; x += 16) {
+        uint8x16x4_t r0 = vld4q_u8(src + 4 * x);
+        uint8x16x4_t r1 = vld4q_u8(src + stride + 4 * x);
+        vst1q_u8(u + x, vrhaddq_u8(r0.val[1], r1.val[1]));
+        vst1q_u8(v + x, vrhaddq_u8(r0.val[3], r1.val[3]));
+    }
+    chromaRowScalar(src + 4 * x, stride, u + x, v + x, width - 2 * x);
+}
+
+// (y*CY + c1*k1 + c2*k2 + YUV_ROUND) >> YUV_SHIFT, saturated to 8 bits
+static inline uint8x8_t yuvChannelNeon(int16x8_t y, int16x8_t c1, int16_t k1, int16x8_t c2, int16_t k2)
+{
+    int32x4_t lo = vmull_n_s16(vget_low_s16(y), CY);
+    lo = vmlal_n_s16(lo, vget_low_s16(c1), k1);
+    lo = vmlal_n_s16(lo, vget_low_s16(c2), k2);
+    int32x4_t hi = vmull_n_s16(vget_high_s16(y), CY);
+    hi = vmlal_n_s16(hi, vget_high_s16(c1), k1);
+    hi = vmlal_n_s16(hi, vget_high_s16(c2), k2);
+    return vqmovun_s16(vcombine_s16(vrshrn_n_s32(lo, YUV_SHIFT), vrshrn_n_s32(hi, YUV_SHIFT)));
+}
+
+static void bgrRowNeon(const uint8_t* src, uint8_t* dst, int width)
+{
+    const int16x8_t lumaOffset = vdupq_n_s16(16);
+    const int16x8_t chromaOffset = vdupq_n_s16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8x4_t yuyv = vld4_u8(src + 2 * x); // Y0 U Y1 V of 8 pixel pairs
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[1])), chromaOffset);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[3])), chromaOffset);
+
+        uint8x8_t b[2], g[2], r[2];
+        for (int i = 0; i < 2; ++i) { // Even then odd pixels
+            int16x8_t y = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[2 * i])), lumaOffset);
+            b[i] = yuvChannelNeon(y, u, CUB, v, 0);
+            g[i] = yuvChannelNeon(y, u, CUG, v, CVG);
+            r[i] = yuvChannelNeon(y, v, CVR, u, 0);
+        }
+
+        uint8x8x2_t bz = vzip_u8(b[0], b[1]);
+        uint8x8x2_t gz = vzip_u8(g[0], g[1]);
+        uint8x8x2_t rz = vzip_u8(r[0], r[1]);
+        uint8x16x3_t bgr;
+        bgr.val[0] = vcombine_u8(bz.val[0], bz.val[1]);
+        bgr.val[1] = vcombine_u8(gz.val[0], gz.val[1]);
+        bgr.val[2] = vcombine_u8(rz.val[0], rz.val[1]);
+        vst3q_u8(dst + 3 * x, bgr);
+    }
+    bgrRowScalar(src + 2 * x, dst + 3 * x, width - x);
+}
+
+static void sadRowNeon(const uint8_t* a, const uint8_t* b, uint32_t* sums, int blocks)
+{
+    int i = 0;
+    for (; i + 2 <= blocks; i += 2) {
+        uint8x16_t diff = vabdq_u8(vld1q_u8(a + 8 * i), vld1q_u8(b + 8 * i));
+        // Pairwise widen 16 -> 8 -> 4 -> 2: one total per 8-byte half
+        uint64x2_t sad = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(diff)));
+        sums[i] += static_cast<uint32_t>(vgetq_lane_u64(sad, 0));
+        sums[i + 1] += static_cast<uint32_t>(vgetq_lane_u64(sad, 1));
+    }
+    sadRowScalar(a + 8 * i, b + 8 * i, sums + i, blocks - i);
+}
+
+static constexpr KernelTable NEON_KERNELS = {
+    "neon", yRowNeon, yDecimate2RowNeon, yDecimate4RowNeon, chromaRowNeon, bgrRowNeon, sadRowNeon
+};
+#endif // PIXEL_KERNELS_NEON
+
+// ---------------------------------------------------------------------------
+// Dispatch
+
+static constexpr int MAX_KERNEL_TABLES = 5;
+
+// The implementations this CPU can run, fastest first and scalar last, and
+// the one in use
+struct KernelChoice {
+    const KernelTable* supported[MAX_KERNEL_TABLES];
+    int count = 0;
+    const KernelTable* active = nullptr;
+};
+
+static const KernelTable* findKernels(const KernelChoice& choice, const char* name)
+{
+    for (int i = 0; i < choice.count; ++i) {
+        if (std::strcmp(choice.supported[i]->name, name) == 0) {
+            return choice.supported[i];
+        }
+    }
+    return nullptr;
+}
+
+static KernelChoice detectKernels()
+{
+    KernelChoice choice;
+#ifdef PIXEL_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        choice.supported[choice.count++] = &AVX2_KERNELS;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        choice.supported[choice.count++] = &SSSE3_KERNELS;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        choice.supported[choice.count++] = &SSE2_KERNELS;
+    }
+#endif
+#ifdef PIXEL_KERNELS_NEON
+    choice.supported[choice.count++] = &NEON_KERNELS;
+#endif
+    choice.supported[choice.count++] = &SCALAR_KERNELS;
+    choice.active = choice.supported[0];
+
+    const char* forced = std::getenv("PIXEL_KERNELS");
+    if (forced) {
+        const KernelTable* table = findKernels(choice, forced);
+        if (table != nullptr) {
+            choice.active = table;
+        } else {
+            std::fprintf(stderr, "PIXEL_KERNELS=%s is not supported on this CPU, using %s\n", forced,
+                         choice.active->name);
+        }
+    }
+    return choice;
+}
+
+static KernelChoice& kernelChoice()
+{
+    static KernelChoice choice = detectKernels();
+    return choice;
+}
+
+static const KernelTable& kernels()
+{
+    return *kernelChoice().active;
+}
+
+const char* pixelKernelsImplementation()
+{
+    return kernels().name;
+}
+
+int pixelKernelsSupported(const char** names, int maxNames)
+{
+    const KernelChoice& choice = kernelChoice();
+    int count = choice.count < maxNames ? choice.count : maxNames;
+    for (int i = 0; i < count; ++i) {
+        names[i] = choice.supported[i]->name;
+    }
+    return choice.count;
+}
+
+bool pixelKernelsSelect(const char* name)
+{
+    KernelChoice& choice = kernelChoice();
+    const KernelTable* table = findKernels(choice, name);
+    if (table == nullptr) {
+        return false;
+    }
+    choice.active = table;
+    return true;
+}
+
+void yuyvToY(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, int width, int height)
+{
+    const KernelTable& k = kernels();
+    for (int y = 0; y < height; ++y) {
+        k.yRow(src + y * srcStride, dst + y * dstStride, width);
+    }
+}
+
+void yuyvToYDecimated(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride,
+                      int width, int height, int factor)
+{
+    const KernelTable& k = kernels();
+    if (factor == 4) {
+        for (int y = 0; y < height / 4; ++y) {
+            k.yDecimate4Row(src + 4 * y * srcStride, srcStride, dst + y * dstStride, width / 4);
+        }
+    } else if (factor == 2) {
+        for (int y = 0; y < height / 2; ++y) {
+            k.yDecimate2Row(src + 2 * y * srcStride, srcStride, dst + y * dstStride, width / 2);
+        }
+    } else {
+        yuyvToY(src, srcStride, dst, dstStride, width, height);
+    }
+}
+
+void yuyvToI420(const uint8_t* src, size_t srcStride, uint8_t* y, uint8_t* u, uint8_t* v,
+                int width, int height)
+{
+    const KernelTable& k = kernels();
+    size_t chromaWidth = width / 2;
+    for (int row = 0; row + 1 < height; row += 2) {
+        const uint8_t* line = src + row * srcStride;
+        k.yRow(line, y + row * static_cast<size_t>(width), width);
+        k.yRow(line + srcStride, y + (row + 1) * static_cast<size_t>(width), width);
+        k.chromaRow(line, srcStride, u + (row / 2) * chromaWidth, v + (row / 2) * chromaWidth, width);
+    }
+}
+
+void yuyvToI420Decimated(const uint8_t* src, size_t srcStride, uint8_t* y, uint8_t* u, uint8_t* v,
+                         int width, int height, int factor)
+{
+    int lumaWidth = width / factor;
+    yuyvToYDecimated(src, srcStride, y, lumaWidth, width, height, factor);
+
+    // The chroma planes are a sixteenth (or less) of the frame, so a plain
+    // loop: each sample averages factor chroma columns over 2 * factor rows
+    int chromaWidth = lumaWidth / 2;
+    int chromaHeight = height / factor / 2;
+    int count = 2 * factor * factor;
+    for (int cy = 0; cy < chromaHeight; ++cy) {
+        for (int cx = 0; cx < chromaWidth; ++cx) {
+            int sumU = 0;
+            int sumV = 0;
+            for (int row = 0; row < 2 * factor; ++row) {
+                const uint8_t* p = src + (2 * factor * cy + row) * srcStride + 4 * factor * cx;
+                for (int i = 0; i < factor; ++i) {
+                    sumU += p[4 * i + 1];
+                    sumV += p[4 * i + 3];
+                }
+            }
+            u[cy * chromaWidth + cx] = static_cast<uint8_t>((sumU + count / 2) / count);
+            v[cy * chromaWidth + cx] = static_cast<uint8_t>((sumV + count / 2) / count);
+        }
+    }
+}
+
+void yuyvToI422(const uint8_t* src, size_t srcStride, uint8_t* y, uint8_t* u, uint8_t* v,
+                int width, int height)
+{
+    const KernelTable& k = kernels();
+    size_t chromaWidth = width / 2;
+    for (int row = 0; row < height; ++row) {
+        const uint8_t* line = src + row * srcStride;
+        k.yRow(line, y + row * static_cast<size_t>(width), width);
+        // A zero stride averages the row with itself, i.e. copies its chroma
+        k.chromaRow(line, 0, u + row * chromaWidth, v + row * chromaWidth, width);
+    }
+}
+
+void yuyvToBgr(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, int width, int height)
+{
+    const KernelTable& k = kernels();
+    for (int y = 0; y < height; ++y) {
+        k.bgrRow(src + y * srcStride, dst + y * dstStride, width);
+    }
+}
+
+void blockSad8x8(const uint8_t* a, size_t aStride, const uint8_t* b, size_t bStride,
+                 int width, int height, uint32_t* sads)
+{
+    const KernelTable& k = kernels();
+    int blocksX = width / 8;
+    for (int by = 0; by < height / 8; ++by) {
+        uint32_t* row = sads + by * blocksX;
+        std::memset(row, 0, blocksX * sizeof(uint32_t));
+        for (int y = 8 * by; y < 8 * by + 8; ++y) {
+            k.sadRow(a + y * aStride, b + y * bStride, row, blocksX);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include "PupilDetection.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace cv;
+using namespace std;
+
+void findPupilCandidates(const Mat& eye, vector<Vec3f>& circles)
+{
+    int detect_Pixel = 1;
+    int minimum_Distance = eye.cols / 8;
+    int threshold = 250;
+    int minimum_Area = 15;
+    int minimum_Radius = eye.rows / 6;
+    int maximum_Radius = eye.rows / 2;
+    HoughCircles(eye, circles, HOUGH_GRADIENT, detect_Pixel, minimum_Distance, threshold, minimum_Area, minimum_Radius, maximum_Radius);
+}
+
+// Sum of the pixels strictly inside a circle (dx^2 + dy^2 < r^2 on the rounded
+// centre and radius), one span per row looked up in the summed-area table.
+// Returns false when no pixel of the circle lies inside the image. Rounds
+// halves away from zero like the per-pixel test this replaced: Hough centres
+// often sit on x.5, where cvRound (to even) would pick a different pixel.
+static bool circleSum(const Mat& table, const Vec3f& circle, int64_t& sum)
+{
+    int cx = static_cast<int>(std::lround(circle[0]));
+    int cy = static_cast<int>(std::lround(circle[1]));
+    int radius = static_cast<int>(std::lround(circle[2]));
+    int rows = table.rows - 1;
+    int cols = table.cols - 1;
+
+    sum = 0;
+    int64_t pixels = 0;
+    for (int y = std::max(0, cy - radius + 1); y <= std::min(rows - 1, cy + radius - 1); ++y) {
+        int dy = y - cy;
+        int limit = radius * radius - dy * dy; // dx^2 must stay below this
+        // Largest dx with dx^2 < limit
+        int dx = static_cast<int>(std::sqrt(static_cast<double>(limit - 1)));
+        while ((dx + 1) * (dx + 1) < limit) ++dx;
+        while (dx > 0 && dx * dx >= limit) --dx;
+
+        int x0 = std::max(0, cx - dx);
+        int x1 = std::min(cols - 1, cx + dx);
+        if (x0 > x1) {
+            continue;
+        }
+        const int* above = table.ptr<int>(y);
+        const int* below = table.ptr<int>(y + 1);
+        sum += (below[x1 + 1] - below[x0]) - (above[x1 + 1] - above[x0]);
+        pixels += x1 - x0 + 1;
+    }
+    return pixels > 0;
+}
+
+bool eyeBallDetection(const Mat& eye, const vector<Vec3f>& circles, Vec3f& eyeball, Mat& table) {
+    cv::integral(eye, table, CV_32S);
+
+    int64_t smallestSum = std::numeric_limits<int64_t>::max();
+    int smallestSumIndex = -1;
+    for (size_t i = 0; i < circles.size(); i++) {
+        int64_t sum;
+        if (circleSum(table, circles[i], sum) && sum < smallestSum) {
+            smallestSum = sum;
+            smallestSumIndex = static_cast<int>(i);
+        }
+    }
+    if (smallestSumIndex < 0) {
+        return false;
+    }
+    eyeball = circles[smallestSumIndex];
+    return true;
+}
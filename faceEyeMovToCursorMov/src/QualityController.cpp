@@ -0,0 +1,82 @@
+#include "QualityController.hpp"
+#include <algorithm>
+
+void QualityController::configure(const QualityControlConfig& config)
+{
+    _config = config;
+    _config.qualityStep = std::max(_config.qualityStep, 1);
+    _config.minQuality = std::clamp(_config.minQuality, 1, 100);
+    _config.maxQuality = std::clamp(_config.maxQuality, _config.minQuality, 100);
+
+    int scales = _config.maxDownscale >= 4 ? 3 : _config.maxDownscale >= 2 ? 2 : 1;
+    _qualityLevels = (_config.maxQuality - _config.minQuality) / _config.qualityStep + 1;
+    _levels = _qualityLevels * scales;
+    _level = 0;
+    _reseed = true;
+    _lastNs = 0;
+    _overFrames = 0;
+    _underFrames = 0;
+    _stepUpFrames = STEP_UP_FRAMES;
+    _steppedUp = false;
+}
+
+EncodeSettings QualityController::settings() const
+{
+    return {_config.maxQuality - (_level % _qualityLevels) * _config.qualityStep,
+            1 << (_level / _qualityLevels)};
+}
+
+bool QualityController::update(uint64_t encodeUs, size_t bytes, uint64_t timestampNs)
+{
+    double interval = _lastNs != 0 && timestampNs > _lastNs ? (timestampNs - _lastNs) / 1e9 : 0.0;
+    _lastNs = timestampNs;
+
+    if (_reseed) {
+        _encodeUs = static_cast<double>(encodeUs);
+        _bytes = static_cast<double>(bytes);
+        _reseed = false;
+    } else {
+        _encodeUs += SMOOTHING * (encodeUs - _encodeUs);
+        _bytes += SMOOTHING * (bytes - _bytes);
+    }
+    // The frame rate does not depend on the settings, so it is never reseeded
+    if (interval > 0.0) {
+        _intervalS = _intervalS > 0.0 ? _intervalS + SMOOTHING * (interval - _intervalS) : interval;
+    }
+    _kbps = _intervalS > 0.0 ? _bytes * 8.0 / _intervalS / 1000.0 : 0.0;
+
+    bool bitrate_limited = _config.bitrateKbps > 0 && _intervalS > 0.0;
+    bool over = _encodeUs > _config.encodeBudgetUs || (bitrate_limited && _kbps > _config.bitrateKbps);
+    bool under = _encodeUs < LOW_WATER * _config.encodeBudgetUs
+                 && (!bitrate_limited || _kbps < LOW_WATER * _config.bitrateKbps);
+    _overFrames = over ? _overFrames + 1 : 0;
+    _underFrames = under ? _underFrames + 1 : 0;
+
+    _sinceStepUp++;
+    if (_steppedUp && _sinceStepUp > _stepUpFrames) {
+        // The last step up held: attempts may come quickly again
+        _stepUpFrames = STEP_UP_FRAMES;
+        _steppedUp = false;
+    }
+
+    int level = _level;
+    if (_overFrames >= STEP_DOWN_FRAMES && _level + 1 < _levels) {
+        level = _level + 1;
+        if (_steppedUp) {
+            _stepUpFrames = std::min(2 * _stepUpFrames, MAX_STEP_UP_FRAMES);
+            _steppedUp = false;
+        }
+    } else if (_underFrames >= _stepUpFrames && _level > 0) {
+        level = _level - 1;
+        _steppedUp = true;
+        _sinceStepUp = 0;
+    }
+    if (level == _level) {
+        return false;
+    }
+    _level = level;
+    _reseed = true;
+    _overFrames = 0;
+    _underFrames = 0;
+    return true;
+}
@@ -0,0 +1,177 @@
+#include "ScheduleTrace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sched.h>
+
+static constexpr int MAX_TRACE_TRACKS = 64;
+static constexpr int SERVICES_PID = 1;
+static constexpr int FRAMES_PID = 2;
+static constexpr int CPU_PID_BASE = 100; // Executions again, grouped by the CPU they ran on
+
+struct TraceTrack {
+    const char* name;
+    TraceGroup group;
+};
+
+struct TraceRecord {
+    uint64_t startNs;
+    uint64_t endNs; // Same as startNs for instant events
+    uint64_t arg;
+    uint16_t track;
+    TraceKind kind;
+    uint8_t cpu;
+    uint32_t reserved;
+};
+
+bool schedule_trace_enabled = false;
+
+static TraceTrack trace_tracks[MAX_TRACE_TRACKS] = {{"untracked", TraceGroup::Services}};
+static int tracks_registered = 1;
+
+static std::unique_ptr<TraceRecord[]> trace_buffer;
+static size_t trace_capacity = 0;
+static std::atomic<size_t> trace_next{0}; // Claimed slots; beyond capacity means dropped
+static uint64_t trace_start_ns = 0;
+
+uint16_t scheduleTraceTrack(const char* name, TraceGroup group)
+{
+    if (tracks_registered == MAX_TRACE_TRACKS) {
+        return 0;
+    }
+    trace_tracks[tracks_registered] = {name, group};
+    return static_cast<uint16_t>(tracks_registered++);
+}
+
+bool scheduleTraceInit(size_t capacity)
+{
+    trace_buffer.reset(new (std::nothrow) TraceRecord[capacity]);
+    if (!trace_buffer) {
+        std::fprintf(stderr, "Failed to allocate a trace buffer of %zu events\n", capacity);
+        return false;
+    }
+    // Touch every page now rather than on the first event that lands on it
+    std::memset(trace_buffer.get(), 0, capacity * sizeof(TraceRecord));
+    trace_capacity = capacity;
+    trace_next.store(0, std::memory_order_relaxed);
+    trace_start_ns = monotonicNowNs();
+    schedule_trace_enabled = true;
+    return true;
+}
+
+void scheduleTraceRecord(TraceKind kind, uint16_t track, uint64_t startNs, uint64_t endNs, uint64_t arg)
+{
+    size_t slot = trace_next.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= trace_capacity) {
+        return;
+    }
+    int cpu = sched_getcpu();
+    trace_buffer[slot] = {startNs, endNs, arg, track, kind, static_cast<uint8_t>(cpu < 0 ? 0 : cpu), 0};
+}
+
+static double traceUs(uint64_t ns)
+{
+    return ns > trace_start_ns ? (ns - trace_start_ns) / 1000.0 : 0.0;
+}
+
+static void writeMetadata(FILE* out, const char* what, int pid, int tid, const char* name, bool& first)
+{
+    std::fprintf(out, "%s\n{\"ph\":\"M\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                 first ? "" : ",", what, pid, tid, name);
+    first = false;
+}
+
+static void writeRecord(FILE* out, const TraceRecord& record)
+{
+    const TraceTrack& track = trace_tracks[record.track];
+    double ts = traceUs(record.startNs);
+    double dur = record.endNs > record.startNs ? (record.endNs - record.startNs) / 1000.0 : 0.0;
+
+    switch (record.kind) {
+    case TraceKind::Release:
+    case TraceKind::ReleaseSkipped:
+    case TraceKind::ReleaseCoalesced: {
+        const char* names[] = {"release", "release skipped", "release coalesced"};
+        std::fprintf(out, ",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+                     names[static_cast<int>(record.kind)], ts, SERVICES_PID, record.track);
+        break;
+    }
+    case TraceKind::Execution: {
+        double delay = record.arg != 0 && record.startNs > record.arg ? (record.startNs - record.arg) / 1000.0 : 0.0;
+        for (int pid : {SERVICES_PID, CPU_PID_BASE + record.cpu}) {
+            std::fprintf(out, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+                              "\"args\":{\"cpu\":%u,\"start_delay_us\":%.3f}}",
+                         track.name, ts, dur, pid, record.track, record.cpu, delay);
+        }
+        break;
+    }
+    case TraceKind::Stage:
+        std::fprintf(out, ",\n{\"ph\":\"X\",\"name\":\"frame %llu\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+                          "\"args\":{\"frame\":%llu,\"cpu\":%u}}",
+                     static_cast<unsigned long long>(record.arg), ts, dur, FRAMES_PID, record.track,
+                     static_cast<unsigned long long>(record.arg), record.cpu);
+        break;
+    }
+}
+
+void scheduleTraceDeinit(const std::string& path)
+{
+    if (!schedule_trace_enabled) {
+        return;
+    }
+    schedule_trace_enabled = false;
+    size_t claimed = trace_next.load(std::memory_order_relaxed);
+    size_t recorded = std::min(claimed, trace_capacity);
+
+    FILE* out = std::fopen(path.c_str(), "w");
+    if (out == nullptr) {
+        std::fprintf(stderr, "Failed to open trace file %s: %s\n", path.c_str(), strerror(errno));
+        trace_buffer.reset();
+        return;
+    }
+
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+    bool first = true;
+    writeMetadata(out, "process_name", SERVICES_PID, 0, "services", first);
+    writeMetadata(out, "process_name", FRAMES_PID, 0, "frames", first);
+    for (int i = 1; i < tracks_registered; ++i) {
+        int pid = trace_tracks[i].group == TraceGroup::Frames ? FRAMES_PID : SERVICES_PID;
+        writeMetadata(out, "thread_name", pid, i, trace_tracks[i].name, first);
+    }
+
+    // Name the per-CPU groups and the service rows in them that were used
+    bool cpu_used[256] = {};
+    for (size_t i = 0; i < recorded; ++i) {
+        if (trace_buffer[i].kind == TraceKind::Execution) {
+            cpu_used[trace_buffer[i].cpu] = true;
+        }
+    }
+    for (int cpu = 0; cpu < 256; ++cpu) {
+        if (!cpu_used[cpu]) {
+            continue;
+        }
+        char name[16];
+        std::snprintf(name, sizeof(name), "CPU %d", cpu);
+        writeMetadata(out, "process_name", CPU_PID_BASE + cpu, 0, name, first);
+        for (int i = 1; i < tracks_registered; ++i) {
+            if (trace_tracks[i].group == TraceGroup::Services) {
+                writeMetadata(out, "thread_name", CPU_PID_BASE + cpu, i, trace_tracks[i].name, first);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < recorded; ++i) {
+        writeRecord(out, trace_buffer[i]);
+    }
+    std::fputs("\n]}\n", out);
+    bool failed = std::ferror(out) != 0;
+    failed |= std::fclose(out) != 0;
+
+    std::printf("Schedule trace %s: %zu events, %zu dropped (buffer full)%s\n", path.c_str(), recorded,
+                claimed - recorded, failed ? ", write failed" : "");
+    trace_buffer.reset();
+    trace_capacity = 0;
+}
@@ -22,18 +22,50 @@
 #include "Compression.hpp"
 #include "MessageQueue.hpp"
 #include "ImageProcessing.hpp"
+#include "LatencyTrace.hpp"
+#include "FrameBus.hpp"
+#include "PixelKernels.hpp"
+#include "ImageWriter.hpp"
+#include "Metrics.hpp"
+#include "ScheduleTrace.hpp"
 
-static constexpr uint8_t CURSOR_TRANSLATION_PRIORITY= 99;
-static constexpr uint8_t IMAGE_CAPTURE_PRIORITY= 98;
-static constexpr uint8_t FACE_EYE_DETECTION_PRIORITY= 97;
-static constexpr uint8_t IMAGE_COMPRESSION_PRIORITY= 99;
-static constexpr uint8_t LOGGING_PRIORITY= 98;
+// Priority 99 is reserved for the sequencer's dispatcher thread
+static constexpr uint8_t CURSOR_TRANSLATION_PRIORITY= 98;
+static constexpr uint8_t CURSOR_OUTPUT_PRIORITY= 98;
+static constexpr uint8_t IMAGE_CAPTURE_PRIORITY= 97;
+static constexpr uint8_t FACE_EYE_DETECTION_PRIORITY= 96;
+static constexpr uint8_t IMAGE_COMPRESSION_PRIORITY= 98;
 
 static constexpr uint8_t CURSOR_TRANSLATION_DEADLINE= 50;
 static constexpr uint8_t IMAGE_CAPTURE_DEADLINE= 60;
 static constexpr uint8_t FACE_EYE_DETECTION_DEADLINE= 100;
 static constexpr uint8_t IMAGE_COMPRESSION_DEADLINE= 70;
-static constexpr uint8_t LOGGING_DEADLINE= 250;
+
+// Worst-case execution time budgets (us) used by --sched deadline and the RM checks
+static constexpr uint32_t CURSOR_TRANSLATION_RUNTIME_US= 2000;
+static constexpr uint32_t CURSOR_OUTPUT_RUNTIME_US= 100;
+static constexpr uint32_t IMAGE_CAPTURE_RUNTIME_US= 5000;
+static constexpr uint32_t FACE_EYE_DETECTION_RUNTIME_US= 60000;
+static constexpr uint32_t IMAGE_COMPRESSION_RUNTIME_US= 30000;
+static constexpr uint32_t DETECTION_DISPATCH_RUNTIME_US= 2000; // DetectionService with a worker pool
+
+// Rate limits (ms between starts) for services released on data by their producer
+static constexpr uint32_t CURSOR_TRANSLATION_MIN_INTERVAL_MS= 0;
+static constexpr uint32_t FACE_EYE_DETECTION_MIN_INTERVAL_MS= 30;
+
+// Accepted --cursor-rate range; the sequencer schedules in whole milliseconds
+static constexpr unsigned MIN_CURSOR_RATE_HZ = 250;
+static constexpr unsigned MAX_CURSOR_RATE_HZ = 1000;
+
+// How often live latency and service statistics are printed while running
+static constexpr uint32_t STATS_REPORT_INTERVAL_MS = 10000;
+
+// Main loop period, shorter while the --overlay window needs refreshing
+static constexpr uint32_t MAIN_LOOP_INTERVAL_MS = 100;
+static constexpr uint32_t OVERLAY_REFRESH_MS = 33;
+
+// Events kept by --trace (32 bytes each); a few minutes at the default rates
+static constexpr size_t TRACE_BUFFER_EVENTS = 1 << 20;
 std::atomic<bool> _runningstate{true};
 
 void signalHandler(int signum)
@@ -51,10 +83,40 @@ int main(int argc, char* argv[])
     }
     
     if (argc < 2) {
-        std::cerr << "Detection Type: " << argv[0] << " <method_number>\n"
+        std::cerr << "Detection Type: " << argv[0] << " <method_number> [options]\n"
                   << "Where <method_number> corresponds to the detection type:\n"
                   << "  1: Face Detection\n"
-                  << "  2: Eye Detection\n";
+                  << "  2: Eye Detection\n"
+                  << "Options:\n"
+                  << "  --device <path>        V4L2 capture device (default /dev/video0)\n"
+                  << "  --replay <file>        Replay a YUYV recording instead of the camera\n"
+                  << "  --replay-speed <x>     Replay rate multiplier, 0 = as fast as possible\n"
+                  << "  --loop                 Restart the replay when it ends\n"
+                  << "  --record <file>        Record captured frames to <file>\n"
+                  << "  --zmq-export <ep>      Also publish raw frames on ZMQ endpoint <ep>\n"
+                  << "  --buffers <n>          Number of capture buffers (default 8)\n"
+                  << "  --sched <mode>         fixed (default), rm (rate-monotonic FIFO) or deadline (SCHED_DEADLINE)\n"
+                  << "  --placement <mode>     fixed (default) or auto: latency-critical services pinned to\n"
+                  << "                         isolated CPUs (isolcpus/nohz_full) by utilization, batch elsewhere\n"
+                  << "  --periodic             Release detection and cursor periodically instead of on new data\n"
+                  << "  --no-tracking          Scan the whole frame for the face on every detection\n"
+                  << "  --decimate <1|2|4>     Run detection on luma scaled down by this factor (default 1)\n"
+                  << "  --overlay              Show detections in a debug window\n"
+                  << "  --detection-workers <n> Detect on n worker threads (0-4, default 0 = inline)\n"
+                  << "  --filter <type>        Cursor smoothing: avg (moving average), euro (One-Euro, default)\n"
+                  << "                         or kalman (constant velocity, predicts to the current time)\n"
+                  << "  --jpeg <encoder>       turbo (libjpeg-turbo from YUV, default) or opencv (imencode from BGR)\n"
+                  << "  --jpeg-420             Subsample chroma to 4:2:0 before turbo encoding\n"
+                  << "  --motion-gate <level>  Only record frames whose luma changed by more than <level>\n"
+                  << "                         (mean per 32x32 block, e.g. 6) since the last recorded one\n"
+                  << "  --keyframe-interval <n> With --motion-gate, still record every n-th frame (default 150, 0 = off)\n"
+                  << "  --encode-budget <ms>   Lower JPEG quality/resolution to keep encoding under <ms> per frame\n"
+                  << "  --bitrate <kbit/s>     With --encode-budget (or alone), also keep the recording under this rate\n"
+                  << "  --cursor-rate <hz>     Move the cursor at <hz> (250-1000), gliding between filtered\n"
+                  << "                         targets, instead of once per detection\n"
+                  << "  --metrics <socket>     Serve live metrics (Prometheus text) on Unix socket <socket>\n"
+                  << "  --trace <file>         Record service releases/executions and frame stages, written\n"
+                  << "                         to <file> at exit as Chrome trace JSON (open in Perfetto)\n";
         return 1;
     }
 
@@ -63,53 +125,271 @@ int main(int argc, char* argv[])
         std::cerr << "Invalid input. Please enter 1 (Face Detection), 2 (Eye Detection)\n";
         return 1;
     }
-    
 
+    CaptureConfig capture_config;
+    std::string zmq_export_endpoint;
+    SchedulingMode scheduling_mode = SchedulingMode::Fixed;
+    PlacementMode placement_mode = PlacementMode::Fixed;
+    bool data_triggered = true;
+    DetectionConfig detection_config;
+    CursorFilterConfig filter_config;
+    unsigned cursor_rate_hz = 0;
+    CompressionConfig compression_config;
+    std::string metrics_socket;
+    std::string trace_file;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--device" && i + 1 < argc) {
+            capture_config.device = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            capture_config.replayFile = argv[++i];
+        } else if (arg == "--replay-speed" && i + 1 < argc) {
+            capture_config.replaySpeed = std::stod(argv[++i]);
+        } else if (arg == "--loop") {
+            capture_config.replayLoop = true;
+        } else if (arg == "--record" && i + 1 < argc) {
+            capture_config.recordFile = argv[++i];
+        } else if (arg == "--buffers" && i + 1 < argc) {
+            capture_config.bufferCount = std::stoul(argv[++i]);
+            if (capture_config.bufferCount < 2) {
+                std::cerr << "--buffers needs at least 2 buffers\n";
+                return 1;
+            }
+        } else if (arg == "--sched" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "fixed") {
+                scheduling_mode = SchedulingMode::Fixed;
+            } else if (mode == "rm") {
+                scheduling_mode = SchedulingMode::RateMonotonic;
+            } else if (mode == "deadline") {
+                scheduling_mode = SchedulingMode::Deadline;
+            } else {
+                std::cerr << "Unknown scheduling mode: " << mode << "\n";
+                return 1;
+            }
+        } else if (arg == "--placement" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "fixed") {
+                placement_mode = PlacementMode::Fixed;
+            } else if (mode == "auto") {
+                placement_mode = PlacementMode::Automatic;
+            } else {
+                std::cerr << "Unknown placement mode: " << mode << "\n";
+                return 1;
+            }
+        } else if (arg == "--periodic") {
+            data_triggered = false;
+        } else if (arg == "--no-tracking") {
+            detection_config.faceTracking = false;
+        } else if (arg == "--decimate" && i + 1 < argc) {
+            detection_config.lumaDecimation = std::stoi(argv[++i]);
+            if (detection_config.lumaDecimation != 1 && detection_config.lumaDecimation != 2
+                && detection_config.lumaDecimation != 4) {
+                std::cerr << "--decimate must be 1, 2 or 4\n";
+                return 1;
+            }
+        } else if (arg == "--overlay") {
+            detection_config.overlay = true;
+        } else if (arg == "--detection-workers" && i + 1 < argc) {
+            detection_config.workers = std::stoi(argv[++i]);
+            if (detection_config.workers < 0 || detection_config.workers > MAX_DETECTION_WORKERS) {
+                std::cerr << "--detection-workers must be between 0 and " << MAX_DETECTION_WORKERS << "\n";
+                return 1;
+            }
+        } else if (arg == "--filter" && i + 1 < argc) {
+            std::string type = argv[++i];
+            if (type == "avg") {
+                filter_config.type = CursorFilterType::MovingAverage;
+            } else if (type == "euro") {
+                filter_config.type = CursorFilterType::OneEuro;
+            } else if (type == "kalman") {
+                filter_config.type = CursorFilterType::Kalman;
+            } else {
+                std::cerr << "Unknown cursor filter: " << type << "\n";
+                return 1;
+            }
+        } else if (arg == "--jpeg" && i + 1 < argc) {
+            std::string encoder = argv[++i];
+            if (encoder == "turbo") {
+                compression_config.encoder = JpegEncoder::TurboJpeg;
+            } else if (encoder == "opencv") {
+                compression_config.encoder = JpegEncoder::OpenCv;
+            } else {
+                std::cerr << "Unknown JPEG encoder: " << encoder << "\n";
+                return 1;
+            }
+        } else if (arg == "--jpeg-420") {
+            compression_config.chroma420 = true;
+        } else if (arg == "--motion-gate" && i + 1 < argc) {
+            compression_config.motionGate = true;
+            compression_config.motionThreshold = std::stoi(argv[++i]);
+            if (compression_config.motionThreshold < 0 || compression_config.motionThreshold > 255) {
+                std::cerr << "--motion-gate must be between 0 and 255\n";
+                return 1;
+            }
+        } else if (arg == "--keyframe-interval" && i + 1 < argc) {
+            compression_config.keyframeInterval = std::stoul(argv[++i]);
+        } else if (arg == "--encode-budget" && i + 1 < argc) {
+            compression_config.adaptiveQuality = true;
+            compression_config.encodeBudgetUs = static_cast<uint32_t>(std::stod(argv[++i]) * 1000);
+        } else if (arg == "--bitrate" && i + 1 < argc) {
+            compression_config.adaptiveQuality = true;
+            compression_config.bitrateKbps = std::stoul(argv[++i]);
+        } else if (arg == "--cursor-rate" && i + 1 < argc) {
+            cursor_rate_hz = std::stoul(argv[++i]);
+            if (cursor_rate_hz < MIN_CURSOR_RATE_HZ || cursor_rate_hz > MAX_CURSOR_RATE_HZ) {
+                std::cerr << "--cursor-rate must be between " << MIN_CURSOR_RATE_HZ << " and " << MAX_CURSOR_RATE_HZ << " Hz\n";
+                return 1;
+            }
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            metrics_socket = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (arg == "--zmq-export" && i + 1 < argc) {
+            zmq_export_endpoint = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
 
     // Declare sequencer outside try block to ensure scope in catch
     Sequencer sequencer;
 
     // Initialize resources
     try {
-        cursorInit(detection_type);
-		initImageProcessingService(detection_type);
-        imageCaptureInit();
-        initialize_zmq();
-        initCompressionService();
-        initLoggingService();
+        cursorInit(detection_type, filter_config, cursor_rate_hz > 0);
+		initImageProcessingService(detection_type, detection_config);
+        if (!imageCaptureInit(capture_config)) {
+            std::cerr << "Error: No frame source available\n";
+            cursorDeinit();
+            return 1;
+        }
+        std::printf("Pixel kernels: %s\n", pixelKernelsImplementation());
+        initialize_zmq(zmq_export_endpoint);
+        initCompressionService(compression_config);
+        std::printf("JPEG encoder: %s, image writer: %s\n", compressionEncoderName(), imageWriterBackend());
+        if (initLoggingService()) {
+            std::printf("Logging events to %s\n", getLogFileName().c_str());
+        }
 
         // Add services
-        sequencer.addService("cursorTranslationService", cursorTranslationService, 0, CURSOR_TRANSLATION_PRIORITY, CURSOR_TRANSLATION_DEADLINE);
-        sequencer.addService("imageCaptureService", imageCaptureService, 0, IMAGE_CAPTURE_PRIORITY, IMAGE_CAPTURE_DEADLINE);
-        sequencer.addService("DetectionService", DetectionService, 0, FACE_EYE_DETECTION_PRIORITY, FACE_EYE_DETECTION_DEADLINE);
-        sequencer.addService("imageCompressionService", imageCompressionService, 1, IMAGE_COMPRESSION_PRIORITY, IMAGE_COMPRESSION_DEADLINE);
-        sequencer.addService("messageQueueToCsvService", messageQueueToCsvService, 1, LOGGING_PRIORITY, LOGGING_DEADLINE);
+        // Overrunning services run once more with the freshest data instead of
+        // catching up on every missed release; capture just skips a missed slot
+        Service& cursor_service = sequencer.addService("cursorTranslationService", cursorTranslationService, 0, CURSOR_TRANSLATION_PRIORITY, CURSOR_TRANSLATION_DEADLINE)
+            .setBudget(CURSOR_TRANSLATION_RUNTIME_US)
+            .setOverrunPolicy(OverrunPolicy::Coalesce);
+        if (cursor_rate_hz > 0) {
+            // Rounded to the millisecond grid: 250, 333, 500 or 1000 Hz
+            uint8_t cursor_period_ms = static_cast<uint8_t>((1000 + cursor_rate_hz / 2) / cursor_rate_hz);
+            std::printf("Cursor output every %u ms\n", cursor_period_ms);
+            sequencer.addService("cursorOutputService", cursorOutputService, 0, CURSOR_OUTPUT_PRIORITY, cursor_period_ms)
+                .setBudget(CURSOR_OUTPUT_RUNTIME_US)
+                .setOverrunPolicy(OverrunPolicy::SkipNext);
+        }
+        sequencer.addService("imageCaptureService", imageCaptureService, 0, IMAGE_CAPTURE_PRIORITY, IMAGE_CAPTURE_DEADLINE)
+            .setBudget(IMAGE_CAPTURE_RUNTIME_US)
+            .setOverrunPolicy(OverrunPolicy::SkipNext);
+        // With a worker pool DetectionService only hands out frames and
+        // reorders results; the workers run on the other cores
+        bool detection_pool = detection_config.workers > 0;
+        Service& detection_service = sequencer.addService("DetectionService", DetectionService, 0, FACE_EYE_DETECTION_PRIORITY, FACE_EYE_DETECTION_DEADLINE)
+            .setBudget(detection_pool ? DETECTION_DISPATCH_RUNTIME_US : FACE_EYE_DETECTION_RUNTIME_US)
+            .setOverrunPolicy(OverrunPolicy::Coalesce);
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int i = 0; i < detection_config.workers; ++i) {
+            uint8_t affinity = cpus > 1 ? static_cast<uint8_t>(1 + i % (cpus - 1)) : 0;
+            Service& worker = sequencer.addService("DetectionWorker" + std::to_string(i), [i] { detectionWorkerService(i); },
+                                                   affinity, FACE_EYE_DETECTION_PRIORITY, FACE_EYE_DETECTION_DEADLINE)
+                .setBudget(FACE_EYE_DETECTION_RUNTIME_US)
+                .triggerOnData();
+            setDetectionWorkerListener(i, [&worker] { worker.notify(); });
+        }
+        setDetectionResultListener([&detection_service] { detection_service.notify(); });
+
+        // Chain capture -> detection -> cursor: each stage is released as soon
+        // as its input arrives rather than waiting for its next period
+        if (data_triggered) {
+            // The pool is paced by its workers; a rate limit would only delay results
+            detection_service.triggerOnData(detection_pool ? 0 : FACE_EYE_DETECTION_MIN_INTERVAL_MS);
+            frame_bus.setListener("DetectionService", [&detection_service] { detection_service.notify(); });
+            cursor_service.triggerOnData(CURSOR_TRANSLATION_MIN_INTERVAL_MS);
+            face_center_listener = [&cursor_service] { cursor_service.notify(); };
+        }
+        sequencer.addService("imageCompressionService", imageCompressionService, 1, IMAGE_COMPRESSION_PRIORITY, IMAGE_COMPRESSION_DEADLINE)
+            .setBudget(IMAGE_COMPRESSION_RUNTIME_US)
+            .setOverrunPolicy(OverrunPolicy::Coalesce)
+            .setServiceClass(ServiceClass::Batch);
+
+        sequencer.setSchedulingMode(scheduling_mode);
+        sequencer.setPlacementMode(placement_mode);
+
+        // Scrapes only read what the services already count, from a nice'd thread
+        if (!metrics_socket.empty()) {
+            metricsRegister([&sequencer](MetricsWriter& out) { sequencer.collectMetrics(out); });
+            metricsRegister([](MetricsWriter& out) { frame_bus.collectMetrics(out); });
+            metricsRegister(collectLatencyTraceMetrics);
+            metricsRegister(collectCursorMetrics);
+            metricsRegister(collectCompressionMetrics);
+            if (metricsInit(metrics_socket)) {
+                std::printf("Serving metrics on %s\n", metrics_socket.c_str());
+            }
+        }
+
+        if (!trace_file.empty() && scheduleTraceInit(TRACE_BUFFER_EVENTS)) {
+            std::printf("Tracing the schedule to %s\n", trace_file.c_str());
+        }
 
         // Start services
         sequencer.startServices();
 
         // Main loop: Wait until SIGINT or error
+        auto last_report = std::chrono::steady_clock::now();
+        uint32_t loop_interval_ms = detection_config.overlay ? OVERLAY_REFRESH_MS : MAIN_LOOP_INTERVAL_MS;
         while (_runningstate.load(std::memory_order_relaxed)) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            std::this_thread::sleep_for(std::chrono::milliseconds(loop_interval_ms));
+            if (detection_config.overlay) {
+                showDetectionOverlay();
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_report >= std::chrono::milliseconds(STATS_REPORT_INTERVAL_MS)) {
+                last_report = now;
+                latencyTraceReport();
+                sequencer.logLiveStatistics();
+            }
         }
 
         // Shutdown: Stop services and clean up
         std::puts("Stopping services...");
+        metricsDeinit();
         sequencer.stopServices(); // Stop services in main thread
+        scheduleTraceDeinit(trace_file);
+        latencyTraceReport();
+        frame_bus.logStatistics();
+        logDetectionStatistics();
 
         // Clean up resources
         std::puts("Cleaning up resources...");
-        flushCsvFile();
+        deinitLoggingService();
         cursorDeinit();
         cleanup_zmq();
+        deinitCompressionService();
+        deinitImageProcessingService();
+        imageCaptureDeinit();
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         _runningstate.store(false, std::memory_order_relaxed);
+        metricsDeinit();
         sequencer.stopServices(); // Now in scope
-        flushCsvFile();
+        scheduleTraceDeinit(trace_file);
+        deinitLoggingService();
         cursorDeinit();
         cleanup_zmq();
+        deinitCompressionService();
+        deinitImageProcessingService();
+        imageCaptureDeinit();
         return 1;
     }
 
@@ -0,0 +1,194 @@
+// Times pupil scoring (eyeBallDetection, summed-area table) against the
+// per-pixel pow() test it replaced, on the same eye crops and Hough
+// candidates, and checks that both pick the same circle. Crops come from a
+// recording made with --record (left eye of the first face, as the detection
+// service finds it); without one, synthetic crops are used. Run with
+// `make bench [RECORDING=<file>]`; exits non-zero if the two ever disagree.
+#include "FrameSource.hpp"
+#include "PixelKernels.hpp"
+#include "PupilDetection.hpp"
+#include "TimeUtils.hpp"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/objdetect.hpp>
+#include <linux/videodev2.h>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+static constexpr size_t MAX_CROPS = 500;
+static constexpr int SYNTHETIC_CROPS = 200;
+static constexpr uint64_t RUN_NS = 300'000'000ULL; // Per implementation
+static const char* const FACE_CASCADE = "/usr/share/opencv4/haarcascades/haarcascade_frontalface_alt.xml";
+static const char* const EYE_CASCADE = "/usr/share/opencv4/haarcascades/haarcascade_eye.xml";
+
+struct EyeCrop {
+    Mat eye; // Equalized, as the detection service scores it
+    vector<Vec3f> circles;
+};
+
+// The scoring eyeBallDetection used before the summed-area table, kept
+// verbatim apart from returning the index (-1 for no circles)
+static int eyeBallDetectionPow(const Mat& eye, const vector<Vec3f>& circles)
+{
+    vector<int> sums(circles.size(), 0);
+    for (int y = 0; y < eye.rows; y++) {
+        const uchar* data = eye.ptr<uchar>(y);
+        for (int x = 0; x < eye.cols; x++) {
+            int pixel_value = static_cast<int>(*data);
+            for (size_t i = 0; i < circles.size(); i++) {
+                Point center((int)round(circles[i][0]), (int)round(circles[i][1]));
+                int radius = (int)round(circles[i][2]);
+                if (pow(x - center.x, 2) + pow(y - center.y, 2) < pow(radius, 2)) {
+                    sums[i] += pixel_value;
+                }
+            }
+            ++data;
+        }
+    }
+    int smallestSum = 9999999;
+    int smallestSumIndex = -1;
+    for (size_t i = 0; i < circles.size(); i++) {
+        if (sums[i] < smallestSum) {
+            smallestSum = sums[i];
+            smallestSumIndex = static_cast<int>(i);
+        }
+    }
+    return smallestSumIndex;
+}
+
+static void addCrop(vector<EyeCrop>& crops, const Mat& eye)
+{
+    EyeCrop crop;
+    crop.eye = eye.clone();
+    equalizeHist(crop.eye, crop.eye);
+    findPupilCandidates(crop.eye, crop.circles);
+    if (!crop.circles.empty()) {
+        crops.push_back(std::move(crop));
+    }
+}
+
+// Left eye crops of the first face in each recorded frame
+static bool recordedCrops(const char* path, vector<EyeCrop>& crops)
+{
+    CascadeClassifier faceCascade;
+    CascadeClassifier eyeCascade;
+    if (!faceCascade.load(FACE_CASCADE) || !eyeCascade.load(EYE_CASCADE)) {
+        std::fprintf(stderr, "Failed to load the cascades from /usr/share/opencv4/haarcascades\n");
+        return false;
+    }
+    FileFrameSource source(path, 0.0, false, 1);
+    if (!source.open()) {
+        return false;
+    }
+
+    Mat gray;
+    CapturedFrame frame;
+    while (crops.size() < MAX_CROPS && source.acquire(frame)) {
+        if (frame.format == V4L2_PIX_FMT_YUYV) {
+            gray.create(frame.height, frame.width, CV_8UC1);
+            yuyvToY(static_cast<const uint8_t*>(frame.data), frame.width * 2, gray.data, gray.step, frame.width,
+                    frame.height);
+            vector<Rect> faces;
+            faceCascade.detectMultiScale(gray, faces, 1.1, 2, CASCADE_SCALE_IMAGE, Size(150, 150));
+            if (!faces.empty()) {
+                Mat face = gray(faces[0]);
+                vector<Rect> eyes;
+                eyeCascade.detectMultiScale(face, eyes, 1.1, 2, CASCADE_SCALE_IMAGE, Size(30, 30));
+                if (eyes.size() == 2) {
+                    addCrop(crops, face(eyes[0].x < eyes[1].x ? eyes[0] : eyes[1]));
+                }
+            }
+        }
+        source.release(frame.index);
+    }
+    source.close();
+    return true;
+}
+
+// Noisy crops with a dark pupil and a lighter iris around it
+static void syntheticCrops(vector<EyeCrop>& crops)
+{
+    std::mt19937 rng(7);
+    for (int i = 0; i < SYNTHETIC_CROPS; ++i) {
+        int width = 40 + static_cast<int>(rng() % 41);
+        int height = width * 3 / 4;
+        Mat eye(height, width, CV_8UC1);
+        randu(eye, Scalar(150), Scalar(230));
+        Point center(width / 4 + static_cast<int>(rng() % (width / 2)),
+                     height / 3 + static_cast<int>(rng() % (height / 3)));
+        int radius = height / 4 + static_cast<int>(rng() % (height / 8 + 1));
+        circle(eye, center, radius + radius / 2, Scalar(110), FILLED);
+        circle(eye, center, radius, Scalar(25), FILLED);
+        GaussianBlur(eye, eye, Size(3, 3), 0);
+        addCrop(crops, eye);
+    }
+}
+
+// Microseconds per crop, cycling through all of them until RUN_NS is up
+static double usPerCrop(const vector<EyeCrop>& crops, const function<void(const EyeCrop&)>& score)
+{
+    uint64_t start = monotonicNowNs();
+    uint64_t elapsed = 0;
+    uint64_t scored = 0;
+    do {
+        for (const EyeCrop& crop : crops) {
+            score(crop);
+        }
+        scored += crops.size();
+        elapsed = monotonicNowNs() - start;
+    } while (elapsed < RUN_NS);
+    return elapsed / 1000.0 / scored;
+}
+
+int main(int argc, char** argv)
+{
+    vector<EyeCrop> crops;
+    if (argc > 1) {
+        if (!recordedCrops(argv[1], crops)) {
+            return 1;
+        }
+        std::printf("%zu eye crops with pupil candidates from %s\n", crops.size(), argv[1]);
+    } else {
+        syntheticCrops(crops);
+        std::printf("%zu synthetic eye crops with pupil candidates (pass a recording for real ones)\n",
+                    crops.size());
+    }
+    if (crops.empty()) {
+        return 1;
+    }
+
+    // Both must pick the same circle on every crop before timing means anything
+    Mat table;
+    size_t candidates = 0;
+    int mismatches = 0;
+    for (size_t i = 0; i < crops.size(); ++i) {
+        const EyeCrop& crop = crops[i];
+        candidates += crop.circles.size();
+        int expected = eyeBallDetectionPow(crop.eye, crop.circles);
+        Vec3f before = expected >= 0 ? crop.circles[expected] : Vec3f(-1, -1, -1);
+        Vec3f eyeball(-1, -1, -1);
+        eyeBallDetection(crop.eye, crop.circles, eyeball, table);
+        if (eyeball != before) {
+            std::printf("MISMATCH crop %zu (%dx%d, %zu circles): pow() picks (%.1f, %.1f, %.1f), "
+                        "summed-area table (%.1f, %.1f, %.1f)\n",
+                        i, crop.eye.cols, crop.eye.rows, crop.circles.size(), before[0], before[1], before[2],
+                        eyeball[0], eyeball[1], eyeball[2]);
+            mismatches++;
+        }
+    }
+
+    double pow_us = usPerCrop(crops, [](const EyeCrop& crop) { eyeBallDetectionPow(crop.eye, crop.circles); });
+    double table_us = usPerCrop(crops, [&table](const EyeCrop& crop) {
+        Vec3f eyeball;
+        eyeBallDetection(crop.eye, crop.circles, eyeball, table);
+    });
+    std::printf("%.1f candidates per crop: pow() %.2f us, summed-area table %.2f us per crop (x%.1f)\n",
+                static_cast<double>(candidates) / crops.size(), pow_us, table_us, pow_us / table_us);
+    std::printf("%d of %zu crops picked a different circle\n", mismatches, crops.size());
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+// Throughput of every pixel kernel implementation the CPU supports on a
+// camera-sized YUYV frame, in megapixels per second and relative to the
+// scalar one. Run with `make bench`, ideally on an otherwise idle machine.
+#include "PixelKernels.hpp"
+#include "TimeUtils.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+static constexpr int FRAME_WIDTH = 640;
+static constexpr int FRAME_HEIGHT = 480;
+static constexpr uint64_t ROUND_NS = 50'000'000ULL;
+static constexpr int ROUNDS = 5; // The best round counts, to filter out preemption
+static constexpr int MAX_IMPLEMENTATIONS = 8;
+
+// Frames per second the kernel sustains, after one warm-up call
+static double framesPerSecond(const std::function<void()>& kernel)
+{
+    kernel();
+    double best = 0.0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        uint64_t start = monotonicNowNs();
+        uint64_t elapsed = 0;
+        uint64_t frames = 0;
+        do {
+            kernel();
+            frames++;
+            elapsed = monotonicNowNs() - start;
+        } while (elapsed < ROUND_NS);
+        best = std::max(best, frames * 1e9 / elapsed);
+    }
+    return best;
+}
+
+int main()
+{
+    const size_t pixels = static_cast<size_t>(FRAME_WIDTH) * FRAME_HEIGHT;
+    const size_t stride = FRAME_WIDTH * 2;
+    std::vector<uint8_t> yuyv(stride * FRAME_HEIGHT);
+    std::vector<uint8_t> previous(pixels);
+    std::mt19937 rng(1);
+    for (uint8_t& b : yuyv) {
+        b = static_cast<uint8_t>(rng());
+    }
+    for (uint8_t& b : previous) {
+        b = static_cast<uint8_t>(rng());
+    }
+    std::vector<uint8_t> planes(pixels * 2);
+    std::vector<uint8_t> bgr(pixels * 3);
+    std::vector<uint32_t> sads(pixels / 64);
+
+    struct Bench {
+        const char* name;
+        std::function<void()> run;
+    };
+    const Bench benches[] = {
+        {"yuyvToY", [&] { yuyvToY(yuyv.data(), stride, planes.data(), FRAME_WIDTH, FRAME_WIDTH, FRAME_HEIGHT); }},
+        {"yuyvToYDecimated(2)", [&] {
+             yuyvToYDecimated(yuyv.data(), stride, planes.data(), FRAME_WIDTH / 2, FRAME_WIDTH, FRAME_HEIGHT, 2);
+         }},
+        {"yuyvToYDecimated(4)", [&] {
+             yuyvToYDecimated(yuyv.data(), stride, planes.data(), FRAME_WIDTH / 4, FRAME_WIDTH, FRAME_HEIGHT, 4);
+         }},
+        {"yuyvToI420", [&] {
+             yuyvToI420(yuyv.data(), stride, planes.data(), planes.data() + pixels, planes.data() + pixels * 5 / 4,
+                        FRAME_WIDTH, FRAME_HEIGHT);
+         }},
+        {"yuyvToI422", [&] {
+             yuyvToI422(yuyv.data(), stride, planes.data(), planes.data() + pixels, planes.data() + pixels * 3 / 2,
+                        FRAME_WIDTH, FRAME_HEIGHT);
+         }},
+        {"yuyvToBgr", [&] {
+             yuyvToBgr(yuyv.data(), stride, bgr.data(), FRAME_WIDTH * 3, FRAME_WIDTH, FRAME_HEIGHT);
+         }},
+        {"blockSad8x8", [&] {
+             blockSad8x8(planes.data(), FRAME_WIDTH, previous.data(), FRAME_WIDTH, FRAME_WIDTH, FRAME_HEIGHT,
+                         sads.data());
+         }},
+    };
+
+    const char* implementations[MAX_IMPLEMENTATIONS];
+    int count = pixelKernelsSupported(implementations, MAX_IMPLEMENTATIONS);
+    std::printf("%dx%d frames, Mpixel/s (speedup over scalar)\n", FRAME_WIDTH, FRAME_HEIGHT);
+    std::printf("%-22s", "kernel");
+    for (int i = 0; i < count; ++i) {
+        std::printf(" %16s", implementations[i]);
+    }
+    std::printf("\n");
+
+    for (const Bench& bench : benches) {
+        std::printf("%-22s", bench.name);
+        std::vector<double> rates;
+        for (int i = 0; i < count; ++i) {
+            pixelKernelsSelect(implementations[i]);
+            rates.push_back(framesPerSecond(bench.run));
+        }
+        // "scalar" is always last
+        double scalar = rates.back();
+        for (double rate : rates) {
+            char cell[32];
+            std::snprintf(cell, sizeof(cell), "%.0f (x%.1f)", rate * pixels / 1e6, rate / scalar);
+            std::printf(" %16s", cell);
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+// Checks every pixel kernel implementation the CPU supports against the
+// scalar one on random frames: output must be bit-identical, and nothing may
+// be written past the end of a row. Widths are chosen to leave SIMD loop
+// remainders, strides are odd and source rows start unaligned. Run with
+// `make test`; exits non-zero on the first mismatching kernel.
+#include "PixelKernels.hpp"
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+static constexpr uint8_t CANARY = 0xA5;
+static constexpr int MAX_IMPLEMENTATIONS = 8;
+
+// Even frame widths (YUYV pixel pairs) that are not a multiple of any SIMD
+// step, plus one camera-sized width
+static const int WIDTHS[] = {2, 6, 14, 18, 30, 34, 62, 66, 98, 130, 642};
+static const int HEIGHTS[] = {2, 4, 8, 12, 16};
+// Bytes added to each row beyond what the frame needs
+static const int PADDINGS[] = {0, 1, 3, 17};
+// SAD inputs are plain 8-bit images of any width
+static const int SAD_WIDTHS[] = {8, 15, 16, 23, 40, 67, 131, 161};
+
+static std::mt19937 rng(20240611);
+static int checks = 0;
+static int failures = 0;
+
+// A frame of random bytes starting one byte past an aligned address
+struct Frame {
+    std::vector<uint8_t> storage;
+    uint8_t* data;
+    size_t stride;
+};
+
+static Frame randomFrame(size_t rowBytes, int height, int padding)
+{
+    Frame frame;
+    frame.stride = rowBytes + padding;
+    frame.storage.resize(frame.stride * height + 1);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (uint8_t& b : frame.storage) {
+        b = static_cast<uint8_t>(byte(rng));
+    }
+    frame.data = frame.storage.data() + 1;
+    return frame;
+}
+
+// Output written by one implementation: the planes back to back, each
+// followed by a canary region that must survive
+using Kernel = std::function<void(std::vector<uint8_t>& out)>;
+
+static std::vector<uint8_t> runKernel(const char* implementation, size_t outSize, const Kernel& kernel)
+{
+    pixelKernelsSelect(implementation);
+    std::vector<uint8_t> out(outSize, CANARY);
+    kernel(out);
+    return out;
+}
+
+static void compare(const char* kernel, const char* implementation, const char* shape,
+                    const std::vector<uint8_t>& expected, const std::vector<uint8_t>& actual)
+{
+    checks++;
+    if (expected == actual) {
+        return;
+    }
+    size_t at = 0;
+    while (at < expected.size() && expected[at] == actual[at]) {
+        at++;
+    }
+    std::printf("FAIL %s [%s] %s: byte %zu is %u, scalar gives %u\n", kernel, implementation, shape, at,
+                actual[at], expected[at]);
+    failures++;
+}
+
+static void checkAll(const char* kernel, const char* shape, size_t outSize, const Kernel& run,
+                     const char** implementations, int count)
+{
+    std::vector<uint8_t> expected = runKernel("scalar", outSize, run);
+    for (int i = 0; i < count; ++i) {
+        compare(kernel, implementations[i], shape, expected, runKernel(implementations[i], outSize, run));
+    }
+}
+
+static void checkFrameKernels(const char** implementations, int count)
+{
+    for (int width : WIDTHS) {
+        for (int height : HEIGHTS) {
+            for (int padding : PADDINGS) {
+                Frame src = randomFrame(static_cast<size_t>(width) * 2, height, padding);
+                char shape[64];
+                std::snprintf(shape, sizeof(shape), "%dx%d stride %zu", width, height, src.stride);
+                size_t pixels = static_cast<size_t>(width) * height;
+
+                // Luma rows are padded too, so writes past the row end show up
+                size_t yStride = width + padding + 1;
+                checkAll("yuyvToY", shape, yStride * height, [&](std::vector<uint8_t>& out) {
+                    yuyvToY(src.data, src.stride, out.data(), yStride, width, height);
+                }, implementations, count);
+
+                for (int factor : {2, 4}) {
+                    if (width / factor == 0 || height / factor == 0) {
+                        continue;
+                    }
+                    size_t dStride = width / factor + padding + 1;
+                    const char* name = factor == 2 ? "yuyvToYDecimated(2)" : "yuyvToYDecimated(4)";
+                    checkAll(name, shape, dStride * (height / factor), [&](std::vector<uint8_t>& out) {
+                        yuyvToYDecimated(src.data, src.stride, out.data(), dStride, width, height, factor);
+                    }, implementations, count);
+                }
+
+                // Planar outputs are tightly packed: one canary byte after each plane
+                size_t chroma420 = pixels / 4;
+                checkAll("yuyvToI420", shape, pixels + 2 * chroma420 + 3, [&](std::vector<uint8_t>& out) {
+                    uint8_t* y = out.data();
+                    uint8_t* u = y + pixels + 1;
+                    uint8_t* v = u + chroma420 + 1;
+                    yuyvToI420(src.data, src.stride, y, u, v, width, height);
+                }, implementations, count);
+
+                size_t chroma422 = pixels / 2;
+                checkAll("yuyvToI422", shape, pixels + 2 * chroma422 + 3, [&](std::vector<uint8_t>& out) {
+                    uint8_t* y = out.data();
+                    uint8_t* u = y + pixels + 1;
+                    uint8_t* v = u + chroma422 + 1;
+                    yuyvToI422(src.data, src.stride, y, u, v, width, height);
+                }, implementations, count);
+
+                size_t bgrStride = static_cast<size_t>(width) * 3 + padding + 1;
+                checkAll("yuyvToBgr", shape, bgrStride * height, [&](std::vector<uint8_t>& out) {
+                    yuyvToBgr(src.data, src.stride, out.data(), bgrStride, width, height);
+                }, implementations, count);
+            }
+        }
+    }
+}
+
+static void checkBlockSad(const char** implementations, int count)
+{
+    for (int width : SAD_WIDTHS) {
+        for (int height : {8, 16, 23, 40}) {
+            for (int padding : PADDINGS) {
+                Frame a = randomFrame(width, height, padding);
+                Frame b = randomFrame(width, height, padding + 2);
+                // Mostly small differences, as between consecutive frames
+                for (int y = 0; y < height; ++y) {
+                    for (int x = 0; x < width; x += 3) {
+                        b.data[y * b.stride + x] = a.data[y * a.stride + x] ^ (x & 7);
+                    }
+                }
+                char shape[64];
+                std::snprintf(shape, sizeof(shape), "%dx%d strides %zu/%zu", width, height, a.stride, b.stride);
+                size_t blocks = static_cast<size_t>(width / 8) * (height / 8);
+                checkAll("blockSad8x8", shape, (blocks + 1) * sizeof(uint32_t), [&](std::vector<uint8_t>& out) {
+                    blockSad8x8(a.data, a.stride, b.data, b.stride, width, height,
+                                reinterpret_cast<uint32_t*>(out.data()));
+                }, implementations, count);
+            }
+        }
+    }
+}
+
+int main()
+{
+    const char* implementations[MAX_IMPLEMENTATIONS];
+    int count = pixelKernelsSupported(implementations, MAX_IMPLEMENTATIONS);
+    std::printf("Pixel kernels supported here:");
+    for (int i = 0; i < count; ++i) {
+        std::printf(" %s", implementations[i]);
+    }
+    std::printf("\n");
+
+    checkFrameKernels(implementations, count);
+    checkBlockSad(implementations, count);
+
+    std::printf("%d checks, %d failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
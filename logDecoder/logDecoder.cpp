@@ -0,0 +1,117 @@
+// Renders the binary event log written by faceEyeMovToCursorMov as CSV.
+// With an event name only that event is printed, with its named columns;
+// otherwise every record is printed with generic value columns.
+#include "LogFormat.hpp"
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static const LogEventInfo* findEvent(uint16_t event)
+{
+    for (const LogEventInfo& info : LOG_EVENTS) {
+        if (static_cast<uint16_t>(info.event) == event) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+static const LogEventInfo* findEvent(const char* name)
+{
+    for (const LogEventInfo& info : LOG_EVENTS) {
+        if (std::strcmp(info.name, name) == 0) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+static void usage(const char* program)
+{
+    std::fprintf(stderr, "Usage: %s <log.bin> [event]\nEvents:", program);
+    for (const LogEventInfo& info : LOG_EVENTS) {
+        std::fprintf(stderr, " %s", info.name);
+    }
+    std::fputc('\n', stderr);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    const LogEventInfo* only = nullptr;
+    if (argc == 3) {
+        only = findEvent(argv[2]);
+        if (only == nullptr) {
+            std::fprintf(stderr, "Unknown event: %s\n", argv[2]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    FILE* file = std::fopen(argv[1], "rb");
+    if (file == nullptr) {
+        std::perror(argv[1]);
+        return 1;
+    }
+    LogFileHeader header;
+    if (std::fread(&header, sizeof(header), 1, file) != 1
+        || std::memcmp(header.magic, LOG_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        std::fprintf(stderr, "%s is not an event log\n", argv[1]);
+        std::fclose(file);
+        return 1;
+    }
+    if (header.version != LOG_FILE_VERSION || header.recordSize != sizeof(LogRecord)) {
+        std::fprintf(stderr, "%s has version %u with %u-byte records, expected version %u with %zu\n",
+                     argv[1], header.version, header.recordSize, LOG_FILE_VERSION, sizeof(LogRecord));
+        std::fclose(file);
+        return 1;
+    }
+
+    std::printf("unix_time,monotonic_ns,event,source,sequence");
+    for (size_t i = 0; i < LOG_VALUES; ++i) {
+        if (only != nullptr) {
+            std::printf(",%s", only->fields[i]);
+        } else {
+            std::printf(",value%zu", i);
+        }
+    }
+    std::putchar('\n');
+
+    // Sequence numbers are per source; a jump means the ring overflowed
+    static uint32_t next_sequence[UINT16_MAX + 1];
+    static bool seen[UINT16_MAX + 1];
+    uint64_t gaps = 0;
+    LogRecord record;
+    while (std::fread(&record, sizeof(record), 1, file) == 1) {
+        if (seen[record.source] && record.sequence != next_sequence[record.source]) {
+            gaps += record.sequence - next_sequence[record.source];
+        }
+        seen[record.source] = true;
+        next_sequence[record.source] = record.sequence + 1;
+
+        const LogEventInfo* info = findEvent(record.event);
+        if (only != nullptr && info != only) {
+            continue;
+        }
+        int64_t realtime = static_cast<int64_t>(header.realtimeStartNs)
+                           + (static_cast<int64_t>(record.timestampNs) - static_cast<int64_t>(header.monotonicStartNs));
+        std::printf("%" PRId64 ".%06" PRId64 ",%" PRIu64 ",%s,%u,%u", realtime / 1'000'000'000,
+                    (realtime % 1'000'000'000) / 1000, record.timestampNs,
+                    info != nullptr ? info->name : std::to_string(record.event).c_str(),
+                    record.source, record.sequence);
+        for (size_t i = 0; i < LOG_VALUES; ++i) {
+            std::printf(",%" PRId64, record.values[i]);
+        }
+        std::putchar('\n');
+    }
+    std::fclose(file);
+
+    if (gaps > 0) {
+        std::fprintf(stderr, "%" PRIu64 " records were dropped while logging\n", gaps);
+    }
+    return 0;
+}
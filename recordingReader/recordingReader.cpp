@@ -0,0 +1,232 @@
+// Reads recordings written by faceEyeMovToCursorMov's image writer: lists the
+// segments, extracts single frames by id or exports whole ranges as JPEGs.
+#include "SegmentFormat.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct Segment {
+    uint32_t number;
+    std::string dataPath;
+    uint64_t dataSize;
+    std::vector<SegmentIndexEntry> entries;
+};
+
+static void usage(const char* program)
+{
+    std::fprintf(stderr,
+                 "Usage: %s <command> <recording dir> [args]\n"
+                 "Commands:\n"
+                 "  list                          Summary of every segment\n"
+                 "  frames                        One line per recorded frame\n"
+                 "  extract <frame id> <out.jpg>  Write a single frame\n"
+                 "  export <out dir> [first] [last] [every]\n"
+                 "                                Write frames first..last (ids), every n-th one\n",
+                 program);
+}
+
+// Index of one segment; entries pointing past the end of the data file (a
+// crash between the two writes) and a torn last entry are left out
+static bool loadSegment(const std::string& directory, uint32_t number, Segment& segment)
+{
+    std::string index_path = segmentFileName(directory, number, "idx");
+    FILE* index = std::fopen(index_path.c_str(), "rb");
+    if (index == nullptr) {
+        std::fprintf(stderr, "Cannot open %s: %s\n", index_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    SegmentIndexHeader header;
+    if (std::fread(&header, sizeof(header), 1, index) != 1
+        || std::memcmp(header.magic, SEGMENT_INDEX_MAGIC, sizeof(header.magic)) != 0
+        || header.version != SEGMENT_INDEX_VERSION) {
+        std::fprintf(stderr, "%s is not a segment index\n", index_path.c_str());
+        std::fclose(index);
+        return false;
+    }
+
+    segment.number = number;
+    segment.dataPath = segmentFileName(directory, number, "mjpg");
+    std::error_code ec;
+    segment.dataSize = std::filesystem::file_size(segment.dataPath, ec);
+    if (ec) {
+        segment.dataSize = 0;
+    }
+    segment.entries.clear();
+    SegmentIndexEntry entry;
+    while (std::fread(&entry, sizeof(entry), 1, index) == 1) {
+        if (entry.offset + entry.size <= segment.dataSize) {
+            segment.entries.push_back(entry);
+        }
+    }
+    std::fclose(index);
+    return true;
+}
+
+static std::vector<Segment> loadRecording(const std::string& directory)
+{
+    std::vector<uint32_t> numbers;
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(directory, ec)) {
+        unsigned number;
+        char extension[8];
+        if (sscanf(file.path().filename().c_str(), "segment_%u.%7s", &number, extension) == 2
+            && std::strcmp(extension, "idx") == 0) {
+            numbers.push_back(number);
+        }
+    }
+    if (ec) {
+        std::fprintf(stderr, "Cannot read %s: %s\n", directory.c_str(), ec.message().c_str());
+    }
+    std::sort(numbers.begin(), numbers.end());
+
+    std::vector<Segment> segments;
+    for (uint32_t number : numbers) {
+        Segment segment;
+        if (loadSegment(directory, number, segment)) {
+            segments.push_back(std::move(segment));
+        }
+    }
+    return segments;
+}
+
+static bool readFrame(const Segment& segment, const SegmentIndexEntry& entry, std::vector<unsigned char>& jpeg)
+{
+    FILE* data = std::fopen(segment.dataPath.c_str(), "rb");
+    if (data == nullptr) {
+        std::fprintf(stderr, "Cannot open %s: %s\n", segment.dataPath.c_str(), strerror(errno));
+        return false;
+    }
+    jpeg.resize(entry.size);
+    bool ok = fseeko(data, static_cast<off_t>(entry.offset), SEEK_SET) == 0
+              && std::fread(jpeg.data(), 1, jpeg.size(), data) == jpeg.size();
+    std::fclose(data);
+    if (!ok) {
+        std::fprintf(stderr, "Short read of frame %llu\n", static_cast<unsigned long long>(entry.frameId));
+    }
+    return ok;
+}
+
+static bool writeFile(const std::string& path, const std::vector<unsigned char>& data)
+{
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (out == nullptr) {
+        std::fprintf(stderr, "Cannot create %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = std::fwrite(data.data(), 1, data.size(), out) == data.size();
+    ok = std::fclose(out) == 0 && ok;
+    return ok;
+}
+
+static int listSegments(const std::vector<Segment>& segments)
+{
+    std::printf("%-8s %8s %14s %14s %12s %10s\n", "segment", "frames", "first frame", "last frame", "bytes", "seconds");
+    for (const Segment& segment : segments) {
+        if (segment.entries.empty()) {
+            std::printf("%-8u %8d\n", segment.number, 0);
+            continue;
+        }
+        const SegmentIndexEntry& first = segment.entries.front();
+        const SegmentIndexEntry& last = segment.entries.back();
+        std::printf("%-8u %8zu %14llu %14llu %12llu %10.1f\n", segment.number, segment.entries.size(),
+                    static_cast<unsigned long long>(first.frameId), static_cast<unsigned long long>(last.frameId),
+                    static_cast<unsigned long long>(segment.dataSize),
+                    (last.timestampNs - first.timestampNs) / 1e9);
+    }
+    return 0;
+}
+
+static int listFrames(const std::vector<Segment>& segments)
+{
+    std::printf("%-8s %14s %20s %12s %10s\n", "segment", "frame", "timestamp (ns)", "offset", "size");
+    for (const Segment& segment : segments) {
+        for (const SegmentIndexEntry& entry : segment.entries) {
+            std::printf("%-8u %14llu %20llu %12llu %10u\n", segment.number,
+                        static_cast<unsigned long long>(entry.frameId),
+                        static_cast<unsigned long long>(entry.timestampNs),
+                        static_cast<unsigned long long>(entry.offset), entry.size);
+        }
+    }
+    return 0;
+}
+
+// Frame ids grow within a segment, so each index is binary searched
+static int extractFrame(const std::vector<Segment>& segments, uint64_t frame_id, const std::string& out_path)
+{
+    for (const Segment& segment : segments) {
+        auto it = std::lower_bound(segment.entries.begin(), segment.entries.end(), frame_id,
+                                   [](const SegmentIndexEntry& e, uint64_t id) { return e.frameId < id; });
+        if (it == segment.entries.end() || it->frameId != frame_id) {
+            continue;
+        }
+        std::vector<unsigned char> jpeg;
+        return readFrame(segment, *it, jpeg) && writeFile(out_path, jpeg) ? 0 : 1;
+    }
+    std::fprintf(stderr, "Frame %llu is not in the recording\n", static_cast<unsigned long long>(frame_id));
+    return 1;
+}
+
+static int exportFrames(const std::vector<Segment>& segments, const std::string& out_dir,
+                        uint64_t first, uint64_t last, uint64_t every)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(out_dir, ec);
+    if (ec) {
+        std::fprintf(stderr, "Cannot create %s: %s\n", out_dir.c_str(), ec.message().c_str());
+        return 1;
+    }
+
+    std::vector<unsigned char> jpeg;
+    uint64_t exported = 0;
+    uint64_t seen = 0;
+    for (const Segment& segment : segments) {
+        for (const SegmentIndexEntry& entry : segment.entries) {
+            if (entry.frameId < first || entry.frameId > last || seen++ % every != 0) {
+                continue;
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "/frame_%08llu.jpg", static_cast<unsigned long long>(entry.frameId));
+            if (!readFrame(segment, entry, jpeg) || !writeFile(out_dir + name, jpeg)) {
+                return 1;
+            }
+            exported++;
+        }
+    }
+    std::printf("Exported %llu frames to %s\n", static_cast<unsigned long long>(exported), out_dir.c_str());
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string command = argv[1];
+    std::vector<Segment> segments = loadRecording(argv[2]);
+
+    if (command == "list") {
+        return listSegments(segments);
+    }
+    if (command == "frames") {
+        return listFrames(segments);
+    }
+    if (command == "extract" && argc == 5) {
+        return extractFrame(segments, std::strtoull(argv[3], nullptr, 10), argv[4]);
+    }
+    if (command == "export" && argc >= 4) {
+        uint64_t first = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 0;
+        uint64_t last = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : UINT64_MAX;
+        uint64_t every = argc > 6 ? std::max<uint64_t>(std::strtoull(argv[6], nullptr, 10), 1) : 1;
+        return exportFrames(segments, argv[3], first, last, every);
+    }
+    usage(argv[0]);
+    return 1;
+}